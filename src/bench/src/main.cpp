@@ -0,0 +1,163 @@
+#include "unfolding/load_data.hpp"
+#include "unfolding/bin.hpp"
+#include "unfolding/binning_pipeline.hpp"
+#include "unfolding/migration_mat.hpp"
+#include "unfolding/system_solver.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static const char* USAGE =
+R"(Usage: unfold-bench [bins count...]
+Compares dense solvers on 1D gaussian data, default bins: 50 100 200 500 1000 2000 3000
+  legacy    inverse of C and SVD of the doubled matrix (SolveSystem)
+  cholesky  normal equations of the same problem (SolveSystemCholesky)
+  standard  decomposition of TikhonovSolver and one solve
+Checks that the L-curve alpha MSE is within a factor of the best of GCV and manual alpha
+)";
+
+constexpr size_t EVENTS_COUNT = 4000000;
+constexpr double ALPHA = 0.0001;
+constexpr Float LCURVE_MAX_MSE_RATIO = 3;
+
+// Same model as the GUI gaus example, fixed seed
+InputData CreateGausData()
+{
+	std::mt19937 gen{ 42 };
+	std::normal_distribution<> d{ 5, 2 };
+	std::normal_distribution<> smear{ -3.5, 0.5 };
+
+	Column sim{ "sim" };
+	Column exp{ "exp" };
+	sim.mData.reserve( EVENTS_COUNT );
+	exp.mData.reserve( EVENTS_COUNT );
+	for( size_t i = 0; i < EVENTS_COUNT; i++ )
+	{
+		auto exp_value = d( gen );
+		sim.mData.push_back( (Float)( 0.5 * exp_value + smear( gen ) ) );
+		exp.mData.push_back( (Float)exp_value );
+	}
+	std::vector<Column> cols;
+	cols.push_back( std::move( sim ) );
+	cols.push_back( std::move( exp ) );
+	return CreateInputData( std::move( cols ) );
+}
+
+template <typename F>
+auto Measure( double& ms, F func )
+{
+	auto begin = std::chrono::steady_clock::now();
+	auto res = func();
+	ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - begin ).count();
+	return res;
+}
+
+Float MaxDiff( const dfVec& f, const dfVec& s )
+{
+	Float diff = 0;
+	for( int i = 0; i < f.length(); i++ )
+		diff = std::max( diff, std::abs( f[i] - s[i] ) );
+	return diff;
+}
+
+Float MaxAbs( const dfVec& vec )
+{
+	Float max = 0;
+	for( int i = 0; i < vec.length(); i++ )
+		max = std::max( max, std::abs( vec[i] ) );
+	return max;
+}
+
+void Run( const std::vector<Int>& bins_counts )
+{
+	auto data = CreateGausData();
+	auto splited_sim = SplitData( data.mSim, 2 );
+	auto splited_exp = SplitData( data.mExp, 2 );
+
+	std::cout << std::format( "{:>6} {:>12} {:>12} {:>12} {:>14} {:>14} {:>14} {:>14}\n",
+							  "bins", "legacy ms", "cholesky ms", "standard ms", "cholesky err", "standard err", "lcurve alpha", "lcurve ratio" );
+	size_t lcurve_failures = 0;
+	for( auto bins_count : bins_counts )
+	{
+		auto bins = CalculateBins( splited_sim[0], splited_exp[0], 1, 0, BinningType::Static, bins_count );
+		auto stats = CalculateBinningStats( bins, splited_sim[0], splited_exp[0], 0 );
+		auto A = CalculateMigrationMat( stats );
+		auto [m, exp_hist] = CalculateHistograms( bins, splited_sim[1], splited_exp[1], 0 );
+		auto C = CalculateNeighborsMat( bins, stats, NeighborsMatType::Binary );
+		auto Cf = FluctuateMat( C );
+
+		double legacy_ms, cholesky_ms, standard_ms;
+		auto legacy = Measure( legacy_ms, [&]
+		{
+			return SolveSystem( A, C, MatInverse( Cf ), m, ALPHA, false );
+		} );
+		auto cholesky = Measure( cholesky_ms, [&]
+		{
+			return SolveSystemCholesky( A, Cf, m, ALPHA );
+		} );
+		TikhonovSolver solver;
+		auto standard = Measure( standard_ms, [&]
+		{
+			solver = TikhonovSolver( A, Cf );
+			return solver.Solve( m, ALPHA );
+		} );
+
+		// L-curve MSE against the better of GCV and the manual alpha
+		auto scan = solver.ScanAlpha( m );
+		auto mse = [&]( AlphaSelection selection )
+		{
+			return MeanSquaredError( solver.Solve( m, scan.Alpha( selection, ALPHA ) ), exp_hist );
+		};
+		auto lcurve_ratio = mse( AlphaSelection::LCurve ) / std::min( mse( AlphaSelection::Gcv ), mse( AlphaSelection::Manual ) );
+		if( !( lcurve_ratio <= LCURVE_MAX_MSE_RATIO ) )
+			lcurve_failures++;
+
+		// Errors relative to the legacy solution, all three solve the same problem
+		auto norm = MaxAbs( legacy );
+		norm = norm ? norm : 1;
+		std::cout << std::format( "{:>6} {:>12.1f} {:>12.1f} {:>12.1f} {:>14.3e} {:>14.3e} {:>14.3e} {:>14.3f}\n",
+								  bins.Size(),
+								  legacy_ms,
+								  cholesky_ms,
+								  standard_ms,
+								  MaxDiff( cholesky, legacy ) / norm,
+								  MaxDiff( standard, legacy ) / norm,
+								  scan.Alpha( AlphaSelection::LCurve, ALPHA ),
+								  lcurve_ratio );
+	}
+	if( lcurve_failures )
+		throw std::runtime_error( std::format( "L-curve MSE is over {} times the GCV or manual one for {} binnings",
+											   LCURVE_MAX_MSE_RATIO,
+											   lcurve_failures ) );
+}
+
+int main( int argc, char** argv )
+{
+	std::vector<Int> bins_counts;
+	try
+	{
+		for( int i = 1; i < argc; i++ )
+			bins_counts.push_back( std::stoi( argv[i] ) );
+	}
+	catch( const std::exception& )
+	{
+		std::cerr << USAGE;
+		return 1;
+	}
+	if( bins_counts.empty() )
+		bins_counts = { 50, 100, 200, 500, 1000, 2000, 3000 };
+
+	try
+	{
+		Run( bins_counts );
+	}
+	catch( const std::exception& e )
+	{
+		std::cerr << "Benchmark failed with: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,557 @@
+#include "unfolding/load_data.hpp"
+#include "unfolding/save_data.hpp"
+#include "unfolding/bin.hpp"
+#include "unfolding/binning_pipeline.hpp"
+#include "unfolding/migration_mat.hpp"
+#include "unfolding/system_solver.hpp"
+#include "unfolding/iterative_solver.hpp"
+#include "unfolding/bootstrap.hpp"
+#include "unfolding/sweep.hpp"
+#include "unfolding/cross_validation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+struct CliOptions
+{
+	std::string mFilePath;
+	std::string mOutputDir = ".";
+	BinningType mBinningType = BinningType::Static;
+	NeighborsMatType mNeighborsMatType = NeighborsMatType::Binary;
+	Int mBinsNum = BIN_SIZE;
+	size_t mDims = 1;
+	size_t mDimShift = 0;
+	double mAlpha = 0.0001;
+	AlphaSelection mAlphaSelection = AlphaSelection::Manual;
+	DenseSolverType mSolverType = DenseSolverType::Standard;
+	UnfoldingMethod mUnfoldingMethod = UnfoldingMethod::Tikhonov;
+	size_t mIterations = ITERATIVE_DEFAULT_ITERATIONS;
+	Float mTolerance = ITERATIVE_DEFAULT_TOLERANCE;
+	size_t mBootstrapReplicas = 0;
+	bool mBootstrapMigration = false;
+	uint64_t mSeed = BOOTSTRAP_DEFAULT_SEED;
+	bool mDebugOutput = false;
+	bool mStream = false;
+	bool mSweep = false;
+	// k-fold cross validation instead of the training/testing halves, 0 disables
+	size_t mFolds = 0;
+	// Lists of the swept options, single values outside of the sweep
+	SweepGrid mSweepGrid;
+};
+
+static const char* USAGE =
+R"(Usage: unfold-cli <data file> [options]
+  --binning   static | dynamic | dynamic_median | hybrid | maxi  (static)
+  --bins      bins count per dim                                 (10)
+  --dims      dims count                                         (1)
+  --dim-shift dims shift                                         (0)
+  --neighbors binary | stat | mass_center                        (binary)
+  --solver    standard | legacy | cholesky                       (standard)
+  --method    tikhonov | iterative                               (tikhonov)
+  --iterations iterative unfolding iterations                    (4)
+  --tolerance iterative unfolding early stop, 0 disables         (0.0001)
+  --alpha     regularization parameter | lcurve | gcv            (0.0001)
+  --bootstrap bootstrap replicas count, 0 disables                (0)
+  --bootstrap-migration  fluctuate the migration mat in replicas too
+  --seed      bootstrap random seed                              (1)
+  --out       output directory                                   (.)
+  --debug     print solver steps
+  --stream    read the data file in chunks, for files larger than memory
+  --folds     k-fold cross validation folds count, 0 disables    (0)
+              writes cross_validation.txt
+  --sweep     unfold every combination of comma separated --binning, --bins,
+              --dims, --neighbors and --alpha values with the tikhonov method,
+              writes sweep.txt
+)";
+
+static const std::unordered_map<std::string_view, BinningType> BINNING_TYPES = {
+	{ "static", BinningType::Static },
+	{ "dynamic", BinningType::Dynamic },
+	{ "dynamic_median", BinningType::DynamicMedian },
+	{ "hybrid", BinningType::Hybrid },
+	{ "maxi", BinningType::Maxi }
+};
+
+static const std::unordered_map<std::string_view, NeighborsMatType> NEIGHBORS_MAT_TYPES = {
+	{ "binary", NeighborsMatType::Binary },
+	{ "stat", NeighborsMatType::NonbinaryStatistic },
+	{ "mass_center", NeighborsMatType::NonbinaryMassCenters }
+};
+
+template <typename T>
+T ParseEnum( std::string_view value, const std::unordered_map<std::string_view, T>& names )
+{
+	auto iter = names.find( value );
+	if( iter == names.end() )
+		throw std::runtime_error( std::format( "Unknown value {}", value ) );
+	return iter->second;
+}
+
+template <typename T>
+std::string_view EnumName( T value, const std::unordered_map<std::string_view, T>& names )
+{
+	for( const auto& [name, named_value] : names )
+		if( named_value == value )
+			return name;
+	return "unknown";
+}
+
+// Comma separated values
+template <typename F>
+auto ParseList( std::string_view value, F&& parse )
+{
+	std::vector<decltype( parse( value ) )> res;
+	size_t begin = 0;
+	while( true )
+	{
+		auto end = value.find( ',', begin );
+		res.push_back( parse( value.substr( begin, end == std::string_view::npos ? end : end - begin ) ) );
+		if( end == std::string_view::npos )
+			return res;
+		begin = end + 1;
+	}
+}
+
+SweepAlpha ParseAlpha( std::string_view value )
+{
+	if( value == "lcurve" )
+		return { AlphaSelection::LCurve, 0 };
+	if( value == "gcv" )
+		return { AlphaSelection::Gcv, 0 };
+	return { AlphaSelection::Manual, std::stod( std::string( value ) ) };
+}
+
+CliOptions ParseOptions( int argc, char** argv )
+{
+	CliOptions options;
+	for( int i = 1; i < argc; i++ )
+	{
+		std::string_view arg = argv[i];
+		if( arg == "--debug" )
+		{
+			options.mDebugOutput = true;
+			continue;
+		}
+		if( arg == "--stream" )
+		{
+			options.mStream = true;
+			continue;
+		}
+		if( arg == "--bootstrap-migration" )
+		{
+			options.mBootstrapMigration = true;
+			continue;
+		}
+		if( arg == "--sweep" )
+		{
+			options.mSweep = true;
+			continue;
+		}
+		if( !arg.starts_with( "--" ) )
+		{
+			if( !options.mFilePath.empty() )
+				throw std::runtime_error( std::format( "Unexpected argument {}", arg ) );
+			options.mFilePath = arg;
+			continue;
+		}
+		if( i + 1 >= argc )
+			throw std::runtime_error( std::format( "Missing value for {}", arg ) );
+
+		std::string value = argv[++i];
+		auto& grid = options.mSweepGrid;
+		if( arg == "--binning" )
+		{
+			grid.mBinningTypes = ParseList( value, []( std::string_view v ) { return ParseEnum( v, BINNING_TYPES ); } );
+			options.mBinningType = grid.mBinningTypes.front();
+		}
+		else if( arg == "--neighbors" )
+		{
+			grid.mNeighborsMatTypes = ParseList( value, []( std::string_view v ) { return ParseEnum( v, NEIGHBORS_MAT_TYPES ); } );
+			options.mNeighborsMatType = grid.mNeighborsMatTypes.front();
+		}
+		else if( arg == "--solver" )
+			options.mSolverType = ParseEnum<DenseSolverType>( value, { { "standard", DenseSolverType::Standard },
+																	   { "legacy", DenseSolverType::Legacy },
+																	   { "cholesky", DenseSolverType::Cholesky } } );
+		else if( arg == "--method" )
+			options.mUnfoldingMethod = ParseEnum<UnfoldingMethod>( value, { { "tikhonov", UnfoldingMethod::Tikhonov },
+																			{ "iterative", UnfoldingMethod::Iterative } } );
+		else if( arg == "--iterations" )
+			options.mIterations = std::stoul( value );
+		else if( arg == "--tolerance" )
+			options.mTolerance = std::stod( value );
+		else if( arg == "--bins" )
+		{
+			grid.mBinsCounts = ParseList( value, []( std::string_view v ) { return (Int)std::stoi( std::string( v ) ); } );
+			options.mBinsNum = grid.mBinsCounts.front();
+		}
+		else if( arg == "--dims" )
+		{
+			grid.mDims = ParseList( value, []( std::string_view v ) { return (size_t)std::stoul( std::string( v ) ); } );
+			options.mDims = grid.mDims.front();
+		}
+		else if( arg == "--dim-shift" )
+			options.mDimShift = std::stoul( value );
+		else if( arg == "--alpha" )
+		{
+			grid.mAlphas = ParseList( value, ParseAlpha );
+			options.mAlphaSelection = grid.mAlphas.front().mSelection;
+			if( options.mAlphaSelection == AlphaSelection::Manual )
+				options.mAlpha = grid.mAlphas.front().mValue;
+		}
+		else if( arg == "--bootstrap" )
+			options.mBootstrapReplicas = std::stoul( value );
+		else if( arg == "--folds" )
+			options.mFolds = std::stoul( value );
+		else if( arg == "--seed" )
+			options.mSeed = std::stoull( value );
+		else if( arg == "--out" )
+			options.mOutputDir = value;
+		else
+			throw std::runtime_error( std::format( "Unknown option {}", arg ) );
+	}
+
+	if( options.mFilePath.empty() )
+		throw std::runtime_error( "Data file is not specified" );
+
+	auto& grid = options.mSweepGrid;
+	auto lists = { grid.mBinningTypes.size(), grid.mBinsCounts.size(), grid.mDims.size(), grid.mNeighborsMatTypes.size(), grid.mAlphas.size() };
+	if( !options.mSweep && std::ranges::max( lists ) > 1 )
+		throw std::runtime_error( "Value lists need --sweep" );
+	if( grid.mBinningTypes.empty() )
+		grid.mBinningTypes = { options.mBinningType };
+	if( grid.mBinsCounts.empty() )
+		grid.mBinsCounts = { options.mBinsNum };
+	if( grid.mDims.empty() )
+		grid.mDims = { options.mDims };
+	if( grid.mNeighborsMatTypes.empty() )
+		grid.mNeighborsMatTypes = { options.mNeighborsMatType };
+	if( grid.mAlphas.empty() )
+		grid.mAlphas = { { options.mAlphaSelection, options.mAlpha } };
+	grid.mDimShift = options.mDimShift;
+
+	for( auto bins_num : grid.mBinsCounts )
+		if( bins_num < (Int)MIN_BIN_SIZE || bins_num > (Int)MAX_BIN_SIZE )
+			throw std::runtime_error( std::format( "Bins count must be in [{}, {}]", MIN_BIN_SIZE, MAX_BIN_SIZE ) );
+	return options;
+}
+
+// Loaded data and views of its training and testing halves
+struct SplitInput
+{
+	InputData mData;
+	EventsView mTrainingSim;
+	EventsView mTrainingExp;
+	EventsView mTestingSim;
+	EventsView mTestingExp;
+};
+
+InputData LoadInputData( const CliOptions& options )
+{
+	auto data = LoadData( { options.mFilePath } );
+	auto max_dims = data.mSim.Dims();
+	for( auto dims : options.mSweepGrid.mDims )
+		if( dims < 1 || dims > max_dims )
+			throw std::runtime_error( std::format( "Dims must be in [1, {}]", max_dims ) );
+	if( options.mDimShift >= max_dims )
+		throw std::runtime_error( std::format( "Dim shift must be in [0, {}]", max_dims - 1 ) );
+	return data;
+}
+
+SplitInput LoadSplitData( const CliOptions& options )
+{
+	SplitInput res;
+	res.mData = LoadInputData( options );
+	size_t parts = 2;
+	auto splited_sim = SplitData( res.mData.mSim, parts );
+	auto splited_exp = SplitData( res.mData.mExp, parts );
+	res.mTrainingSim = splited_sim[0];
+	res.mTrainingExp = splited_exp[0];
+	res.mTestingSim = splited_sim[1];
+	res.mTestingExp = splited_exp[1];
+	return res;
+}
+
+struct BinnedData
+{
+	Bins mBins;
+	BinningStats mStats;
+	dfVec mSimHist;
+	dfVec mExpHist;
+};
+
+BinnedData BinData( const CliOptions& options )
+{
+	if( options.mStream )
+	{
+		auto res = StreamBinning( options.mFilePath,
+								  options.mDims,
+								  options.mDimShift,
+								  options.mBinningType,
+								  options.mBinsNum );
+		return { std::move( res.mBins ), std::move( res.mStats ), res.mSimTestHist, res.mExpTestHist };
+	}
+
+	auto data = LoadSplitData( options );
+	auto bins = CalculateBins( data.mTrainingSim,
+							   data.mTrainingExp,
+							   options.mDims,
+							   options.mDimShift,
+							   options.mBinningType,
+							   options.mBinsNum );
+	auto stats = CalculateBinningStats( bins, data.mTrainingSim, data.mTrainingExp, options.mDimShift );
+	auto [sim_hist, exp_hist] = CalculateHistograms( bins, data.mTestingSim, data.mTestingExp, options.mDimShift );
+	return { std::move( bins ), std::move( stats ), sim_hist, exp_hist };
+}
+
+void RunSweepMode( const CliOptions& options )
+{
+	if( options.mStream )
+		throw std::runtime_error( "Sweep needs the data in memory, --stream isn't supported" );
+	if( options.mUnfoldingMethod != UnfoldingMethod::Tikhonov )
+		throw std::runtime_error( "Sweep supports the tikhonov method only" );
+
+	auto data = LoadSplitData( options );
+	auto rows = RunSweep( data.mTrainingSim, data.mTrainingExp, data.mTestingSim, data.mTestingExp, options.mSweepGrid );
+
+	std::filesystem::create_directories( options.mOutputDir );
+	auto file = OpenOutputFile( ( std::filesystem::path( options.mOutputDir ) / "sweep.txt" ).string() );
+	file << "binning, bins_count, dims, neighbors, alpha_selection, alpha, bins, mse, binning_ms, decomposition_ms, solve_ms\n";
+	const SweepRow* best = nullptr;
+	for( const auto& row : rows )
+	{
+		auto selection = row.mAlphaRequest.mSelection == AlphaSelection::Manual ? "manual"
+						 : row.mAlphaRequest.mSelection == AlphaSelection::LCurve ? "lcurve"
+																				   : "gcv";
+		file << std::format( "{}, {}, {}, {}, {}, {}, {}, {}, {:.3f}, {:.3f}, {:.3f}\n",
+							 EnumName( row.mBinningType, BINNING_TYPES ),
+							 row.mBinsCount,
+							 row.mDims,
+							 EnumName( row.mNeighborsMatType, NEIGHBORS_MAT_TYPES ),
+							 selection,
+							 row.mAlpha,
+							 row.mBins,
+							 row.mMse,
+							 row.mBinningMs,
+							 row.mDecompositionMs,
+							 row.mSolveMs );
+		if( !std::isnan( row.mMse ) && ( !best || row.mMse < best->mMse ) )
+			best = &row;
+	}
+
+	std::cout << std::format( "configurations: {}\n", rows.size() );
+	if( best )
+		std::cout << std::format( "best: binning {} bins count {} dims {} neighbors {} alpha {:g} MSE: {:.3f}\n",
+								  EnumName( best->mBinningType, BINNING_TYPES ),
+								  best->mBinsCount,
+								  best->mDims,
+								  EnumName( best->mNeighborsMatType, NEIGHBORS_MAT_TYPES ),
+								  best->mAlpha,
+								  best->mMse );
+}
+
+// Solver of one binning with the decompositions made once
+struct Unfolder
+{
+	// Unfolds m with the migration of the given stats, nullptr is the original one
+	std::function<dfVec( const BinningStats*, const dfVec&, bool )> mSolve;
+	double mAlpha = 0;
+	// Set for the standard dense solver
+	std::shared_ptr<const TikhonovSolver> mSolver;
+	// Empty for the sparse and iterative solvers
+	dfMat mMigrationMat;
+};
+
+// m is the sim histogram the alpha is selected for
+Unfolder CreateUnfolder( const CliOptions& options, const Bins& bins, const BinningStats& stats, const dfVec& m, bool debug )
+{
+	Unfolder res;
+	auto alpha = res.mAlpha = options.mAlpha;
+	if( options.mUnfoldingMethod == UnfoldingMethod::Iterative )
+	{
+		res.mSolve = [&options, migration_csr = CalculateMigrationCsr( stats )]( const BinningStats* migration, const dfVec& m, bool debug )
+		{
+			return SolveIterative( migration ? CalculateMigrationCsr( *migration ) : migration_csr, m, options.mIterations, options.mTolerance, debug );
+		};
+		return res;
+	}
+	if( bins.Size() >= SPARSE_SOLVER_MIN_BINS )
+	{
+		res.mSolve = [alpha,
+					  migration_csr = CalculateMigrationCsr( stats ),
+					  neighbors_csr = FluctuateMat( CalculateNeighborsCsr( bins, stats, options.mNeighborsMatType ) )]( const BinningStats* migration, const dfVec& m, bool debug )
+		{
+			return SolveSparseSystem( migration ? CalculateMigrationCsr( *migration ) : migration_csr, neighbors_csr, m, alpha, debug );
+		};
+		return res;
+	}
+
+	res.mMigrationMat = CalculateMigrationMat( stats );
+	auto neighbors_mat = CalculateNeighborsMat( bins, stats, options.mNeighborsMatType );
+	auto neighbors_fluctuated = FluctuateMat( neighbors_mat );
+	switch( options.mSolverType )
+	{
+	case DenseSolverType::Standard:
+	{
+		// Replicas with the original migration reuse the decomposition
+		auto solver = std::make_shared<const TikhonovSolver>( res.mMigrationMat, neighbors_fluctuated, debug );
+		alpha = res.mAlpha = solver->ScanAlpha( m ).Alpha( options.mAlphaSelection, options.mAlpha );
+		res.mSolver = solver;
+		res.mSolve = [alpha, solver, neighbors_fluctuated]( const BinningStats* migration, const dfVec& m, bool debug )
+		{
+			if( migration )
+				return TikhonovSolver( CalculateMigrationMat( *migration ), neighbors_fluctuated ).Solve( m, alpha, debug );
+			return solver->Solve( m, alpha, debug );
+		};
+		break;
+	}
+	case DenseSolverType::Legacy:
+		res.mSolve = [alpha, migration_mat = res.mMigrationMat, neighbors_mat, neighbors_inv = MatInverse( neighbors_fluctuated )]( const BinningStats* migration, const dfVec& m, bool debug )
+		{
+			return SolveSystem( migration ? CalculateMigrationMat( *migration ) : migration_mat, neighbors_mat, neighbors_inv, m, alpha, debug );
+		};
+		break;
+	case DenseSolverType::Cholesky:
+		res.mSolve = [alpha, migration_mat = res.mMigrationMat, neighbors_fluctuated]( const BinningStats* migration, const dfVec& m, bool )
+		{
+			return SolveSystemCholesky( migration ? CalculateMigrationMat( *migration ) : migration_mat, neighbors_fluctuated, m, alpha );
+		};
+		break;
+	}
+	return res;
+}
+
+void PrintSolverNotes( const CliOptions& options, size_t bins )
+{
+	if( options.mUnfoldingMethod == UnfoldingMethod::Iterative )
+		return;
+	if( bins >= SPARSE_SOLVER_MIN_BINS )
+	{
+		if( options.mAlphaSelection != AlphaSelection::Manual || options.mSolverType != DenseSolverType::Standard )
+			std::cout << std::format( "Sparse solver is used for {} bins and more, alpha {}\n", SPARSE_SOLVER_MIN_BINS, options.mAlpha );
+	}
+	else if( options.mAlphaSelection != AlphaSelection::Manual && options.mSolverType != DenseSolverType::Standard )
+		std::cout << "Alpha selection needs the standard solver, manual alpha is used\n";
+}
+
+void RunCrossValidationMode( const CliOptions& options )
+{
+	if( options.mStream )
+		throw std::runtime_error( "Cross validation needs the data in memory, --stream isn't supported" );
+
+	auto data = LoadInputData( options );
+	auto cv = RunCrossValidation( data.mSim,
+								  data.mExp,
+								  options.mDims,
+								  options.mDimShift,
+								  options.mBinningType,
+								  options.mBinsNum,
+								  options.mFolds,
+								  [&]( const Bins& bins, const BinningStats& stats, const dfVec& m )
+	{
+		return CreateUnfolder( options, bins, stats, m, false ).mSolve( nullptr, m, false );
+	} );
+
+	std::filesystem::create_directories( options.mOutputDir );
+	auto file = OpenOutputFile( ( std::filesystem::path( options.mOutputDir ) / "cross_validation.txt" ).string() );
+	file << "fold, begin, end, bins, mse\n";
+	for( size_t fold = 0; fold < cv.mFolds.size(); fold++ )
+	{
+		const auto& result = cv.mFolds[fold];
+		file << std::format( "{}, {}, {}, {}, {}\n", fold, result.mBegin, result.mEnd, result.mBins, result.mMse );
+	}
+	PrintSolverNotes( options, cv.mFolds.front().mBins );
+	std::cout << std::format( "folds: {} bins: {} MSE: {:.3f} +- {:.3f}\n", cv.mFolds.size(), cv.mFolds.front().mBins, cv.mMeanMse, cv.mMseRms );
+}
+
+void Run( const CliOptions& options )
+{
+	auto [bins, stats, sim_hist, exp_hist] = BinData( options );
+	std::filesystem::create_directories( options.mOutputDir );
+	auto out = std::filesystem::path( options.mOutputDir );
+
+	PrintSolverNotes( options, bins.Size() );
+	auto unfolder = CreateUnfolder( options, bins, stats, sim_hist, options.mDebugOutput );
+	auto alpha = unfolder.mAlpha;
+	dfVec errors;
+	if( unfolder.mSolver )
+	{
+		auto covariance = unfolder.mSolver->Covariance( sim_hist, alpha );
+		errors = CovarianceErrors( covariance );
+		SaveMat( ( out / "covariance.txt" ).string(), covariance );
+	}
+	// No dense matrices for the sparse solver, migration mat isn't saved
+	if( unfolder.mMigrationMat.rows() )
+		SaveMat( ( out / "migration_mat.txt" ).string(), unfolder.mMigrationMat );
+	auto solution = unfolder.mSolve( nullptr, sim_hist, options.mDebugOutput );
+
+	SaveHistograms( ( out / "histograms.txt" ).string(), { "sim", "exp" }, { &sim_hist, &exp_hist } );
+	if( errors.length() == solution.length() )
+		SaveHistograms( ( out / "solution.txt" ).string(), { "solution", "error" }, { &solution, &errors } );
+	else
+		SaveHistograms( ( out / "solution.txt" ).string(), { "solution" }, { &solution } );
+
+	auto mse = MeanSquaredError( solution, exp_hist );
+	if( options.mUnfoldingMethod == UnfoldingMethod::Iterative )
+		std::cout << std::format( "bins: {} MSE: {:.3f}\n", solution.length(), mse );
+	else
+		std::cout << std::format( "bins: {} alpha: {:g} MSE: {:.3f}\n", solution.length(), alpha, mse );
+
+	if( options.mBootstrapReplicas )
+	{
+		// Exp test histogram is the truth of the replicas
+		auto bootstrap = RunBootstrap( stats,
+									   sim_hist,
+									   exp_hist,
+									   options.mBootstrapReplicas,
+									   options.mBootstrapMigration,
+									   options.mSeed,
+									   [&]( const BinningStats* migration, const dfVec& m ) { return unfolder.mSolve( migration, m, false ); } );
+		SaveHistograms( ( out / "bootstrap.txt" ).string(),
+						{ "mean", "rms", "bias", "coverage" },
+						{ &bootstrap.mMean, &bootstrap.mRms, &bootstrap.mBias, &bootstrap.mCoverage } );
+
+		Float coverage = 0;
+		for( int i = 0; i < bootstrap.mCoverage.length(); i++ )
+			coverage += bootstrap.mCoverage[i];
+		coverage /= (Float)bootstrap.mCoverage.length();
+		std::cout << std::format( "bootstrap replicas: {} mean coverage: {:.3f}\n", bootstrap.mReplicas, coverage );
+	}
+}
+
+int main( int argc, char** argv )
+{
+	CliOptions options;
+	try
+	{
+		options = ParseOptions( argc, argv );
+	}
+	catch( const std::exception& e )
+	{
+		std::cerr << e.what() << "\n\n" << USAGE;
+		return 1;
+	}
+
+	try
+	{
+		if( options.mSweep )
+			RunSweepMode( options );
+		else if( options.mFolds )
+			RunCrossValidationMode( options );
+		else
+			Run( options );
+	}
+	catch( const std::exception& e )
+	{
+		std::cerr << "Unfolding failed with: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
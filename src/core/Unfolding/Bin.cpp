@@ -1,196 +1,438 @@
 
 #include "bin.hpp"
+#include "thread_pool.hpp"
 #include <ranges>
 #include <algorithm>
 #include <stdexcept>
+#include <queue>
+#include <span>
+#include <limits>
+#include <numeric>
 
 void PrintBins( const Bins& bins )
 {
-	for( const Bin& bin : bins )
+	for( size_t i = 0; i < bins.Size(); i++ )
+	{
+		auto bin = bins[i];
 		std::cout << "\nbegin: " << bin.mBegin
 		<< " end" << bin.mEnd
-		<< " end" << bin.mIdx
-		<< " size " << bin.Size();
+		<< " idx" << bin.mIdx;
+	}
 	std::cout << std::endl;
 }
 
-std::pair<sfVec, sfVec> GetMinMax( const std::span<sfVec> exp,
-								   const std::span<sfVec> sim )
+// Column by column, both views must have the same dims
+std::pair<sfVec, sfVec> GetMinMax( const EventsView& exp,
+								   const EventsView& sim )
 {
-	auto dims = exp.front().size();
+	auto dims = exp.Dims();
 	sfVec min( dims, std::numeric_limits<Float>::max() );
 	sfVec max( dims, -std::numeric_limits<Float>::max() );
-	for( size_t i = 0; i < exp.size(); i++ )
+	for( size_t dim = 0; dim < dims; dim++ )
 	{
-		auto s = sim[i];
-		auto e = exp[i];
-		for( size_t j = 0; j < dims; j++ )
+		const auto* e = exp.Col( dim );
+		const auto* s = sim.Col( dim );
+		Float col_min = min[dim];
+		Float col_max = max[dim];
+		for( size_t i = 0; i < exp.Size(); i++ )
 		{
-			min[j] = std::min( std::min( e[j], s[j] ), min[j] );
-			max[j] = std::max( std::max( e[j], s[j] ), max[j] );
+			col_min = std::min( std::min( e[i], s[i] ), col_min );
+			col_max = std::max( std::max( e[i], s[i] ), col_max );
 		}
+		min[dim] = col_min;
+		max[dim] = col_max;
 	}
 	return { min, max };
 }
 
-Bins StaticBinning( const std::span<sfVec> sim,
-					const std::span<sfVec> exp,
-					size_t dims,
-					size_t dims_shift,
-					size_t bins_count )
+Bins StaticBinning( const sfVec& min, const sfVec& max, size_t bins_count )
 {
 	if( bins_count < 1 )
 		std::runtime_error( "Invalid binning size" );
 
-	auto [min, max] = ShiftDimTransform( GetMinMax( sim, exp ), dims, dims_shift );
+	auto dims = min.size();
 	sfVec step( dims );
+	std::vector<std::vector<std::pair<Float, Float>>> edges( dims );
 	for( size_t dim = 0; dim < dims; dim++ )
-		step[dim] = ( max[dim] - min[dim] ) / (Float)bins_count;
-
-	Bins bins;
-	bins.mSize = siVec( dims, bins_count );
-
-	for( size_t i = 0; i < std::pow( bins_count, dims ); i++ )
 	{
-		siVec multi_dim_idx = ToMultidimentionalIdx( i, dims, bins_count );
-		siVec next = multi_dim_idx + 1;
-		bins.PutBin( Bin{ multi_dim_idx,
-						  min + step * multi_dim_idx.cast<Float>(),
-						  min + step * next.cast<Float>() } );
+		step[dim] = ( max[dim] - min[dim] ) / (Float)bins_count;
+		for( size_t i = 0; i < bins_count; i++ )
+			edges[dim].push_back( { min[dim] + step[dim] * (Float)i,
+									i + 1 == bins_count ? max[dim] : min[dim] + step[dim] * (Float)( i + 1 ) } );
 	}
-	bins.mBins.front().mBegin = min;
-	bins.mBins.back().mEnd = max;
 
-	for( size_t i = 0; i < exp.size(); i++ )
-		bins.PutInBin( ShiftDimTransform( { exp[i], sim[i] }, dims, dims_shift ) );
+	Bins bins( std::move( edges ) );
+	bins.mUniform = UniformEdges{ min, max, step };
 
 	return  bins;
 }
 
+Bins StaticBinning( const EventsView& sim,
+					const EventsView& exp,
+					size_t dims,
+					size_t dims_shift,
+					size_t bins_count )
+{
+	auto shifted_sim = sim.ShiftDims( dims, dims_shift );
+	auto shifted_exp = exp.ShiftDims( dims, dims_shift );
+	auto [min, max] = GetMinMax( shifted_sim, shifted_exp );
+	return StaticBinning( min, max, bins_count );
+}
+
+namespace
+{
+
+// Node of the per dim split tree. Ranks are counts of values before the slab,
+// so for events they are also the slab range in the dim's index array
+struct Slab
+{
+	Float mBegin;
+	Float mEnd;
+	uint64_t mRankBegin;
+	uint64_t mRankEnd;
+	// Children are stored next to each other, -1 for leaves
+	int mFirstChild = -1;
+
+	uint64_t Size() const
+	{
+		return mRankEnd - mRankBegin;
+	}
+};
+
+// Splits the most populated slab iterations times, split( slab ) returns
+// the center and the rank of the first value not less than it.
+// Returns leaf edges in order
 template <typename F>
-void DynamicBinning( Bins& bins, 
-					 size_t iterations,
-					 F find_bin_center )
+std::vector<std::pair<Float, Float>> SplitSlabs( std::vector<Slab> slabs, size_t iterations, F split )
 {
-	while( iterations-- )
+	// Most populated first, ties go to the lowest slab as with max_element
+	auto less = [&]( int first, int second )
 	{
-		std::vector<std::vector<int>> projections;
-		for( size_t dim = 0; dim < bins.Dims(); dim++ )
-			projections.push_back( std::vector<int>( bins.mSize[dim] ) );
+		const auto& f = slabs[first];
+		const auto& s = slabs[second];
+		if( f.Size() != s.Size() )
+			return f.Size() < s.Size();
+		if( f.mRankBegin != s.mRankBegin )
+			return f.mRankBegin > s.mRankBegin;
+		return f.mBegin > s.mBegin;
+	};
+	std::priority_queue<int, std::vector<int>, decltype( less )> queue( less );
+	auto roots = slabs.size();
+	for( size_t i = 0; i < roots; i++ )
+		queue.push( (int)i );
 
-		for( const auto& bin : bins )
-			for( size_t dim = 0; dim < bins.Dims(); dim++ )
-				projections[dim][bin.mIdx[dim]] += (int)bin.Size();
+	while( iterations-- )
+	{
+		auto slab_idx = queue.top();
+		queue.pop();
+		auto slab = slabs[slab_idx];
+		auto [center, split_rank] = split( slab );
 
+		slabs[slab_idx].mFirstChild = (int)slabs.size();
+		slabs.push_back( { slab.mBegin, center, slab.mRankBegin, split_rank } );
+		slabs.push_back( { center, slab.mEnd, split_rank, slab.mRankEnd } );
+		queue.push( (int)slabs.size() - 2 );
+		queue.push( (int)slabs.size() - 1 );
+	}
 
-		for( int dim = 0; dim < bins.Dims(); dim++ )
+	std::vector<std::pair<Float, Float>> edges;
+	std::vector<int> stack;
+	for( int i = (int)roots - 1; i >= 0; i-- )
+		stack.push_back( i );
+	while( !stack.empty() )
+	{
+		const auto& slab = slabs[stack.back()];
+		stack.pop_back();
+		if( slab.mFirstChild == -1 )
 		{
-			const auto& projection = projections[dim];
+			edges.push_back( { slab.mBegin, slab.mEnd } );
+			continue;
+		}
+		stack.push_back( slab.mFirstChild + 1 );
+		stack.push_back( slab.mFirstChild );
+	}
+	return edges;
+}
 
-			auto max_iter = std::ranges::max_element( projection );
-			int max_bin = (int)std::distance( projection.begin(), max_iter );
-			
-			Float bin_center = find_bin_center( bins, dim, max_bin );
-			for( int i = 0; i < bins.mBins.size(); i++ )
-			{
-				auto& bin = bins[i];
+// Static slabs of the dim, ranks are filled by the caller
+std::vector<Slab> StaticSlabs( const Bins& bins, size_t dim )
+{
+	const auto& uniform = *bins.mUniform;
+	auto size = (size_t)bins.mSize[dim];
+	std::vector<Slab> slabs;
+	for( size_t i = 0; i < size; i++ )
+	{
+		Float begin = uniform.mMin[dim] + uniform.mStep[dim] * (Float)i;
+		Float end = i + 1 == size ? uniform.mMax[dim] : uniform.mMin[dim] + uniform.mStep[dim] * (Float)( i + 1 );
+		slabs.push_back( { begin, end, 0, 0 } );
+	}
+	return slabs;
+}
 
-				if( bin.mIdx[dim] > max_bin )
-					bin.mIdx[dim]++;
+// Splits of other dims don't change the slab counts of this one,
+// so every dim of the static binning is refined on its own
+template <typename F>
+std::vector<std::pair<Float, Float>> SplitDim( const Bins& bins,
+											   const Float* values,
+											   size_t events_count,
+											   size_t dim,
+											   size_t iterations,
+											   F find_bin_center )
+{
+	if( events_count > std::numeric_limits<uint32_t>::max() )
+		throw std::runtime_error( std::format( "Too many events for dynamic binning {}", events_count ) );
 
-				if( bin.mIdx[dim] == max_bin )
-				{
-					Bin first;
-					first.mIdx = bin.mIdx;
-					first.mBegin = bin.mBegin;
-					first.mEnd = bin.mEnd;
-					first.mEnd[dim] = bin_center;
-
-					Bin second;
-					second.mIdx = bin.mIdx;
-					second.mIdx[dim]++;
-					second.mBegin = bin.mBegin;
-					second.mEnd = bin.mEnd;
-					second.mBegin[dim] = bin_center;
-
-					for( auto& sim_exp : bin )
-					{
-						if( sim_exp.first[dim] < bin_center )
-							first.mData.push_back( sim_exp );
-						else
-							second.mData.push_back( sim_exp );
-					}
+	// Counting sort of events by static slab
+	auto slabs = StaticSlabs( bins, dim );
+	std::vector<int64_t> slab_idxs( events_count );
+	std::vector<uint64_t> offsets( slabs.size() + 1 );
+	for( size_t i = 0; i < events_count; i++ )
+	{
+		slab_idxs[i] = bins.GetUniformDimIdx( values[i], dim );
+		if( slab_idxs[i] == -1 )
+			throw std::runtime_error( std::format( "Value {} is out of binning range", values[i] ) );
+		offsets[slab_idxs[i] + 1]++;
+	}
+	for( size_t i = 0; i < slabs.size(); i++ )
+	{
+		offsets[i + 1] += offsets[i];
+		slabs[i].mRankBegin = slabs[i].mRankEnd = offsets[i];
+	}
+	std::vector<uint32_t> idxs( events_count );
+	for( size_t i = 0; i < events_count; i++ )
+		idxs[slabs[slab_idxs[i]].mRankEnd++] = (uint32_t)i;
 
-					//std::cout << i << std::endl;
-					bins.mBins.erase( bins.mBins.begin() + i );
-					//PrintBins( bins );
-					bins.mBins.emplace( bins.mBins.begin() + i, std::move( second ) );
-					//PrintBins( bins );
-					bins.mBins.emplace( bins.mBins.begin() + i, std::move( first ) );
-					//PrintBins( bins );
-					i++;
-				}
-			}
-			bins.mSize[dim]++;
-		}
+	return SplitSlabs( std::move( slabs ), iterations, [&]( const Slab& slab )
+	{
+		auto range = std::span( idxs ).subspan( slab.mRankBegin, slab.Size() );
+		Float center = find_bin_center( values, range, slab.mBegin, slab.mEnd );
+		auto second_begin = std::partition( range.begin(), range.end(), [&]( uint32_t idx )
+		{
+			return values[idx] < center;
+		} );
+		return std::pair( center, slab.mRankBegin + (uint64_t)std::distance( range.begin(), second_begin ) );
+	} );
+}
+
+// Same splitting over the estimated ranks of a sketch
+std::vector<std::pair<Float, Float>> SplitDim( const Bins& bins,
+											   const QuantileSketch::Cdf& cdf,
+											   size_t dim,
+											   size_t iterations,
+											   bool median )
+{
+	auto slabs = StaticSlabs( bins, dim );
+	for( size_t i = 0; i < slabs.size(); i++ )
+	{
+		slabs[i].mRankBegin = i == 0 ? 0 : cdf.Rank( slabs[i].mBegin );
+		slabs[i].mRankEnd = i + 1 == slabs.size() ? cdf.Count() : cdf.Rank( slabs[i].mEnd );
 	}
-	//PrintBins( bins );
-	std::ranges::sort( bins.mBins, []( const Bin& f, const Bin& s )
+
+	return SplitSlabs( std::move( slabs ), iterations, [&]( const Slab& slab )
 	{
-		return f.mIdx < s.mIdx;
+		Float center = ( slab.mBegin + slab.mEnd ) / 2;
+		if( median && slab.Size() != 0 )
+			center = cdf.Value( slab.mRankBegin + slab.Size() / 2 );
+		auto rank = std::clamp( cdf.Rank( center ), slab.mRankBegin, slab.mRankEnd );
+		return std::pair( center, rank );
 	} );
-	//PrintBins( bins );
-	bins.mCache.clear();
+}
+
+} // namespace
+
+// Refines static bins, exp are the shifted exp events they were built from
+template <typename F>
+void DynamicBinning( Bins& bins,
+					 const EventsView& exp,
+					 size_t iterations,
+					 F find_bin_center )
+{
+	std::vector<std::vector<std::pair<Float, Float>>> edges;
+	for( size_t dim = 0; dim < bins.Dims(); dim++ )
+		edges.push_back( SplitDim( bins, exp.Col( dim ), exp.Size(), dim, iterations, find_bin_center ) );
+	bins = Bins( std::move( edges ) );
+}
+
+void DynamicBinning( Bins& bins,
+					 const std::vector<QuantileSketch::Cdf>& cdfs,
+					 size_t iterations,
+					 bool median )
+{
+	std::vector<std::vector<std::pair<Float, Float>>> edges;
+	for( size_t dim = 0; dim < bins.Dims(); dim++ )
+		edges.push_back( SplitDim( bins, cdfs[dim], dim, iterations, median ) );
+	bins = Bins( std::move( edges ) );
 }
 
 
-Float FindCenterBinDefault( const Bins& bins, int dim, int max_bin )
+Float FindCenterBinDefault( const Float*, std::span<uint32_t>, Float begin, Float end )
 {
-	for( const auto& bin : bins )
-		if( bin.mIdx[dim] == max_bin )
-			return Float( bin.mBegin[dim] + bin.mEnd[dim] ) / 2;
-	throw std::runtime_error( 
-		std::format( "find center failed with max_dim: {} max_bin: {}", dim, max_bin ) );
+	return ( begin + end ) / 2;
 }
 
-Float FindCenterBinMedian( const Bins& bins, int dim, int max_bin )
+Float FindCenterBinMedian( const Float* values, std::span<uint32_t> idxs, Float begin, Float end )
 {
-	std::vector<Float> points;
-	for( const auto& bin : bins )
+	if( idxs.empty() )
+		return ( begin + end ) / 2;
+
+	auto median = idxs.begin() + idxs.size() / 2;
+	std::nth_element( idxs.begin(), median, idxs.end(), [&]( uint32_t f, uint32_t s )
+	{
+		return values[f] < values[s];
+	} );
+	return values[*median];
+}
+
+
+// Candidate edges per bin and their total range for Maxi binning
+constexpr size_t MAXI_CELLS_PER_BIN = 4;
+constexpr size_t MAXI_MIN_CELLS = 256;
+constexpr size_t MAXI_MAX_CELLS = 1024;
+constexpr size_t MAXI_MIN_CHUNK = 64;
+
+// 1D binning maximizing the trace of the migration matrix.
+// Edges are picked among exp quantiles (cells), the best partition of
+// the cells is found by DP over 2D prefix sums of the cells migration counts.
+// pairs are exp, sim sorted by exp
+Bins MaxiBinning( const std::vector<std::pair<Float, Float>>& pairs,
+				  const sfVec& min,
+				  const sfVec& max,
+				  size_t bins_count )
+{
+	auto size = pairs.size();
+
+	// Begins of the cells
+	auto cells_count = std::clamp( bins_count * MAXI_CELLS_PER_BIN, MAXI_MIN_CELLS, MAXI_MAX_CELLS );
+	std::vector<Float> edges{ min[0] };
+	for( size_t i = 1; i < cells_count; i++ )
+	{
+		auto value = pairs[i * size / cells_count].first;
+		if( value > edges.back() )
+			edges.push_back( value );
+	}
+	auto cells = edges.size();
+	auto stride = cells + 1;
+
+	// exp_prefix[i]: events with exp cell < i
+	// migration_prefix[i * stride + j]: events with exp cell < i and sim cell < j
+	std::vector<uint64_t> exp_prefix( stride );
+	std::vector<uint64_t> migration_prefix( stride * stride );
+	size_t exp_cell = 0;
+	for( const auto& [exp_value, sim_value] : pairs )
+	{
+		while( exp_cell + 1 < cells && edges[exp_cell + 1] <= exp_value )
+			exp_cell++;
+		auto sim_cell = std::max<ptrdiff_t>( std::ranges::upper_bound( edges, sim_value ) - edges.begin() - 1, 0 );
+		exp_prefix[exp_cell + 1]++;
+		migration_prefix[( exp_cell + 1 ) * stride + sim_cell + 1]++;
+	}
+	for( size_t i = 1; i < stride; i++ )
+	{
+		exp_prefix[i] += exp_prefix[i - 1];
+		for( size_t j = 1; j < stride; j++ )
+			migration_prefix[i * stride + j] += migration_prefix[( i - 1 ) * stride + j] +
+												migration_prefix[i * stride + j - 1] -
+												migration_prefix[( i - 1 ) * stride + j - 1];
+	}
+
+	// Transposed copy and diagonal keep the DP inner loop contiguous
+	std::vector<uint64_t> migration_prefix_t( stride * stride );
+	std::vector<uint64_t> migration_prefix_diag( stride );
+	for( size_t i = 0; i < stride; i++ )
+	{
+		migration_prefix_diag[i] = migration_prefix[i * stride + i];
+		for( size_t j = 0; j < stride; j++ )
+			migration_prefix_t[j * stride + i] = migration_prefix[i * stride + j];
+	}
+
+	// Diagonal element of the bin made of cells [i, j)
+	auto diagonal = [&]( size_t i, size_t j )
 	{
-		if( bin.mIdx[dim] == max_bin )
+		auto exp_count = exp_prefix[j] - exp_prefix[i];
+		if( exp_count == 0 )
+			return Float( 0 );
+		auto hits = migration_prefix_diag[j] - migration_prefix_t[j * stride + i] -
+					migration_prefix[j * stride + i] + migration_prefix_diag[i];
+		return (Float)hits / (Float)exp_count;
+	};
+
+	// best[j]: max trace of k bins made of cells [0, j)
+	auto bins_num = std::min( bins_count, cells );
+	constexpr auto none = -std::numeric_limits<Float>::infinity();
+	std::vector<Float> best( stride, none );
+	std::vector<Float> next_best( stride );
+	std::vector<uint32_t> cuts( bins_num * stride );
+	best[0] = 0;
+	for( size_t k = 1; k <= bins_num; k++ )
+	{
+		std::ranges::fill( next_best, none );
+		auto first = k;
+		auto last = cells - ( bins_num - k ) + 1;
+		ParallelChunks( last - first, ChunksCount( last - first, MAXI_MIN_CHUNK ), [&]( size_t begin, size_t end, size_t )
 		{
-			for( auto& pair : bin )
-				points.push_back( pair.first[dim] );
-		}
+			const auto* prev = best.data();
+			for( size_t j = first + begin; j < first + end; j++ )
+			{
+				Float max_value = none;
+				size_t cut = 0;
+				for( size_t i = k - 1; i < j; i++ )
+				{
+					auto value = prev[i] + diagonal( i, j );
+					if( value > max_value )
+					{
+						max_value = value;
+						cut = i;
+					}
+				}
+				next_best[j] = max_value;
+				cuts[( k - 1 ) * stride + j] = (uint32_t)cut;
+			}
+		} );
+		std::swap( best, next_best );
 	}
-	std::ranges::sort( points );
-	auto median = points[points.size() / 2];
-	return median;
+
+	std::vector<size_t> bounds( bins_num + 1 );
+	bounds[bins_num] = cells;
+	for( size_t k = bins_num; k > 0; k-- )
+		bounds[k - 1] = cuts[( k - 1 ) * stride + bounds[k]];
+
+	std::vector<std::pair<Float, Float>> bin_edges;
+	for( size_t k = 0; k < bins_num; k++ )
+	{
+		auto end = bounds[k + 1] == cells ? max[0] : edges[bounds[k + 1]];
+		bin_edges.push_back( { edges[bounds[k]], end } );
+	}
+	return Bins( { std::move( bin_edges ) } );
 }
 
+Bins MaxiBinning( const EventsView& sim,
+				  const EventsView& exp,
+				  size_t dims_shift,
+				  size_t bins_count )
+{
+	auto shifted_sim = sim.ShiftDims( 1, dims_shift );
+	auto shifted_exp = exp.ShiftDims( 1, dims_shift );
+	auto [min, max] = GetMinMax( shifted_sim, shifted_exp );
+	auto size = exp.Size();
 
-//Bins MaxiBinning( const std::span<sfVec> sim,
-//				  const std::span<sfVec> exp,
-//				  size_t dims,
-//				  size_t dims_shift,
-//				  size_t bins_count )
-//{
-//	std::vector<std::pair<Float, Float>> pairs;
-//	for( size_t i = 0; i < sim.size(); i++ )
-//		pairs.push_back( )
-//}
+	std::vector<std::pair<Float, Float>> pairs( size );
+	for( size_t i = 0; i < size; i++ )
+		pairs[i] = { shifted_exp( i, 0 ), shifted_sim( i, 0 ) };
+	std::ranges::sort( pairs );
+	return MaxiBinning( pairs, min, max, bins_count );
+}
 
-Bins CalculateBins( const std::span<sfVec> sim,
-					const std::span<sfVec> exp,
+Bins CalculateBins( const EventsView& sim,
+					const EventsView& exp,
 					size_t dims,
 					size_t dims_shift,
 					BinningType type,
 					Int bins_count )
 {
-	if( sim.size() == 0 || exp.size() == 0 )
+	if( sim.Size() == 0 || exp.Size() == 0 )
 		throw std::runtime_error( "Input data are empty" );
 
+	auto shifted_exp = exp.ShiftDims( dims, dims_shift );
 	switch( type )
 	{
 	case BinningType::Static:
@@ -198,13 +440,13 @@ Bins CalculateBins( const std::span<sfVec> sim,
 	case BinningType::Dynamic:
 	{
 		auto bins = StaticBinning( sim, exp, dims, dims_shift, 1 );
-		DynamicBinning( bins, bins_count - 1, FindCenterBinDefault );
+		DynamicBinning( bins, shifted_exp, bins_count - 1, FindCenterBinDefault );
 		return bins;
 	}
 	case BinningType::DynamicMedian:
 	{
 		auto bins = StaticBinning( sim, exp, dims, dims_shift, 1 );
-		DynamicBinning( bins, bins_count - 1, FindCenterBinMedian );
+		DynamicBinning( bins, shifted_exp, bins_count - 1, FindCenterBinMedian );
 		return bins;
 	}
 	case BinningType::Hybrid:
@@ -212,16 +454,164 @@ Bins CalculateBins( const std::span<sfVec> sim,
 		auto static_bins  = std::max( 2, bins_count / 3 );
 		auto dynamic_bins = bins_count - static_bins;
 		auto bins = StaticBinning( sim, exp, dims, dims_shift, static_bins );
-		DynamicBinning( bins, dynamic_bins, FindCenterBinDefault );
+		DynamicBinning( bins, shifted_exp, dynamic_bins, FindCenterBinDefault );
 		return bins;
 	}
 	case BinningType::Maxi:
 	{
-		//if( dims == 1 )
-		//	return MaxiBinning( sim, exp, dims, dims_shift, bins_count );
-		std::cout << "Maxi binning available only for one dim problem";
+		if( dims == 1 )
+			return MaxiBinning( sim, exp, dims_shift, bins_count );
+		std::cout << "Maxi binning available only for one dim problem\n";
 		return StaticBinning( sim, exp, dims, dims_shift, bins_count );
 	}
 	}
 	throw std::runtime_error( "Invalid binning type" );
 }
+
+Bins CalculateBins( const std::vector<QuantileSketch>& exp_sketches,
+					const sfVec& min,
+					const sfVec& max,
+					BinningType type,
+					Int bins_count )
+{
+	std::vector<QuantileSketch::Cdf> cdfs;
+	for( const auto& sketch : exp_sketches )
+		cdfs.push_back( sketch.CalculateCdf() );
+	if( cdfs.empty() || cdfs.front().Count() == 0 )
+		throw std::runtime_error( "Input data are empty" );
+
+	switch( type )
+	{
+	case BinningType::Static:
+		return StaticBinning( min, max, bins_count );
+	case BinningType::Dynamic:
+	case BinningType::DynamicMedian:
+	{
+		auto bins = StaticBinning( min, max, 1 );
+		DynamicBinning( bins, cdfs, bins_count - 1, type == BinningType::DynamicMedian );
+		return bins;
+	}
+	case BinningType::Hybrid:
+	{
+		auto static_bins = std::max( 2, bins_count / 3 );
+		auto dynamic_bins = bins_count - static_bins;
+		auto bins = StaticBinning( min, max, static_bins );
+		DynamicBinning( bins, cdfs, dynamic_bins, false );
+		return bins;
+	}
+	case BinningType::Maxi:
+	{
+		std::cout << "Maxi binning needs all events, static binning is used for streaming\n";
+		return StaticBinning( min, max, bins_count );
+	}
+	}
+	throw std::runtime_error( "Invalid binning type" );
+}
+
+SortedEvents::SortedEvents( const EventsView& sim, const EventsView& exp, size_t dims, size_t dims_shift )
+	: mSim( sim.ShiftDims( dims, dims_shift ) )
+	, mExp( exp.ShiftDims( dims, dims_shift ) )
+	, mOrder( dims )
+{
+	if( exp.Size() > std::numeric_limits<uint32_t>::max() )
+		throw std::runtime_error( std::format( "Too many events for sorting {}", exp.Size() ) );
+
+	ParallelChunks( dims, dims, [&]( size_t begin, size_t end, size_t )
+	{
+		for( size_t dim = begin; dim < end; dim++ )
+		{
+			const auto* values = mExp.Col( dim );
+			auto& order = mOrder[dim];
+			order.resize( mExp.Size() );
+			std::iota( order.begin(), order.end(), uint32_t( 0 ) );
+			std::ranges::stable_sort( order, [&]( uint32_t f, uint32_t s ) { return values[f] < values[s]; } );
+		}
+	} );
+}
+
+std::vector<uint32_t> SortedEvents::Order( size_t dim, size_t exclude_begin, size_t exclude_end ) const
+{
+	std::vector<uint32_t> res;
+	res.reserve( mExp.Size() - std::min( exclude_end - exclude_begin, mExp.Size() ) );
+	for( auto idx : mOrder[dim] )
+		if( idx < exclude_begin || idx >= exclude_end )
+			res.push_back( idx );
+	return res;
+}
+
+Bins CalculateBins( const SortedEvents& events,
+					size_t exclude_begin,
+					size_t exclude_end,
+					BinningType type,
+					Int bins_count )
+{
+	const auto& sim = events.Sim();
+	const auto& exp = events.Exp();
+	auto dims = exp.Dims();
+	if( exp.Size() - std::min( exclude_end - exclude_begin, exp.Size() ) == 0 )
+		throw std::runtime_error( "Input data are empty" );
+
+	// Range of the events before and after the excluded ones
+	sfVec min( dims, std::numeric_limits<Float>::max() );
+	sfVec max( dims, -std::numeric_limits<Float>::max() );
+	for( auto [begin, end] : { std::pair<size_t, size_t>( 0, exclude_begin ), std::pair( exclude_end, exp.Size() ) } )
+	{
+		if( begin >= end )
+			continue;
+		auto [part_min, part_max] = GetMinMax( exp.Subview( begin, end - begin ), sim.Subview( begin, end - begin ) );
+		for( size_t dim = 0; dim < dims; dim++ )
+		{
+			min[dim] = std::min( min[dim], part_min[dim] );
+			max[dim] = std::max( max[dim], part_max[dim] );
+		}
+	}
+
+	// Exact cdfs of the sorted values take the place of sketches
+	auto cdfs = [&]
+	{
+		std::vector<QuantileSketch::Cdf> res;
+		for( size_t dim = 0; dim < dims; dim++ )
+		{
+			std::vector<Float> values;
+			const auto* col = exp.Col( dim );
+			for( auto idx : events.Order( dim, exclude_begin, exclude_end ) )
+				values.push_back( col[idx] );
+			res.push_back( QuantileSketch::Cdf::FromSorted( std::move( values ) ) );
+		}
+		return res;
+	};
+
+	switch( type )
+	{
+	case BinningType::Static:
+		return StaticBinning( min, max, bins_count );
+	case BinningType::Dynamic:
+	case BinningType::DynamicMedian:
+	{
+		auto bins = StaticBinning( min, max, 1 );
+		DynamicBinning( bins, cdfs(), bins_count - 1, type == BinningType::DynamicMedian );
+		return bins;
+	}
+	case BinningType::Hybrid:
+	{
+		auto static_bins = std::max( 2, bins_count / 3 );
+		auto dynamic_bins = bins_count - static_bins;
+		auto bins = StaticBinning( min, max, static_bins );
+		DynamicBinning( bins, cdfs(), dynamic_bins, false );
+		return bins;
+	}
+	case BinningType::Maxi:
+	{
+		if( dims != 1 )
+		{
+			std::cout << "Maxi binning available only for one dim problem\n";
+			return StaticBinning( min, max, bins_count );
+		}
+		std::vector<std::pair<Float, Float>> pairs;
+		for( auto idx : events.Order( 0, exclude_begin, exclude_end ) )
+			pairs.push_back( { exp( idx, 0 ), sim( idx, 0 ) } );
+		return MaxiBinning( pairs, min, max, bins_count );
+	}
+	}
+	throw std::runtime_error( "Invalid binning type" );
+}
@@ -1,14 +1,16 @@
 #pragma once
 
 #include "load_data.hpp"
+#include "quantile_sketch.hpp"
 #include "utils.hpp"
 
 #include <set>
 #include <algorithm>
 #include <iostream>
 #include <format>
-
-size_t FromMultidimentionalIdx( siVec idx, siVec md_size );
+#include <optional>
+#include <cmath>
+#include <limits>
 
 enum class BinningType
 {
@@ -19,14 +21,13 @@ enum class BinningType
 	Maxi
 };
 
+// Bin of the grid, Bins generate them from the edges
 struct Bin
 {
 	// multidimentional index
 	siVec mIdx;
 	sfVec mBegin;
 	sfVec mEnd;
-	// sim, exp
-	std::vector<std::pair<sfVec, sfVec>> mData;
 
 	size_t ValueInBin( const sfVec& value ) const
 	{
@@ -40,52 +41,41 @@ struct Bin
 	{
 		return mIdx.size();
 	}
-	
-	size_t Size() const
-	{
-		return mData.size();
-	}
-	auto begin()
-	{
-		return mData.begin();
-	}
-	auto end()
-	{
-		return mData.end();
-	}
-	auto begin() const
-	{
-		return mData.cbegin();
-	}
-	auto end() const
-	{
-		return mData.cend();
-	}
 };
 
+// Edges of static binning: bin i of dim d begins at mMin[d] + mStep[d] * i
+struct UniformEdges
+{
+	sfVec mMin;
+	sfVec mMax;
+	sfVec mStep;
+};
+
+// Grid of bins made of per dim edges. Flat index of a bin is the sum of its dim indices
+// times mStrides, the first dim changes fastest. Per bin data live in flat arrays of
+// this index, Bin objects are generated on demand
 struct Bins
 {
-	// begin, end
-	mutable std::vector<std::vector<std::pair<Float, Float>>> mCache;
-	std::vector<Bin> mBins;
+	// Per dim begin, end of the bins along it
+	std::vector<std::vector<std::pair<Float, Float>>> mEdges;
 	siVec mSize;
-
-
-	auto begin()
-	{
-		return mBins.begin();
-	}
-	auto end()
-	{
-		return mBins.end();
-	}
-	auto begin() const
+	siVec mStrides;
+	// Set by static binning, lookup becomes arithmetic
+	std::optional<UniformEdges> mUniform;
+
+	Bins() = default;
+	explicit Bins( std::vector<std::vector<std::pair<Float, Float>>> edges )
+		: mEdges( std::move( edges ) )
+		, mSize( mEdges.size() )
+		, mStrides( mEdges.size() )
 	{
-		return mBins.cbegin();
-	}
-	auto end() const
-	{
-		return mBins.cend();
+		int64_t stride = 1;
+		for( size_t dim = 0; dim < Dims(); dim++ )
+		{
+			mSize[dim] = (int64_t)mEdges[dim].size();
+			mStrides[dim] = stride;
+			stride *= mSize[dim];
+		}
 	}
 
 	size_t Dims() const
@@ -93,117 +83,206 @@ struct Bins
 		return mSize.size();
 	}
 
-	size_t OneDimSize() const
+	// Bins count
+	size_t Size() const
 	{
-		size_t res = 1;
-		for( auto dim_size : mSize )
-			res *= dim_size;
-		return res;
+		if( mEdges.empty() )
+			return 0;
+		return size_t( mStrides.data()[Dims() - 1] * mSize.data()[Dims() - 1] );
 	}
 
-	void PutBin( Bin&& bin )
+	int64_t DimIdx( size_t flat_idx, size_t dim ) const
 	{
-		mBins.push_back( std::move( bin ) );
+		return (int64_t)flat_idx / mStrides.data()[dim] % mSize.data()[dim];
 	}
 
-	void PutInBin( std::pair<sfVec, sfVec> sim_exp )
+	siVec Idx( size_t flat_idx ) const
 	{
-		auto& bin = GetBinByValue( sim_exp.first );
-		bin.mData.push_back( sim_exp );
+		siVec res( Dims() );
+		for( size_t dim = 0; dim < Dims(); dim++ )
+			res.data()[dim] = DimIdx( flat_idx, dim );
+		return res;
 	}
 
-	Bin& operator[]( size_t idx )
+	size_t FlatIdx( const siVec& idx ) const
 	{
-		if( idx > mBins.size() )
-			throw std::runtime_error( std::format( "operator[]: Out of bins bound {}", idx ) );
-		return mBins[idx];
+		int64_t res = 0;
+		for( size_t dim = 0; dim < Dims(); dim++ )
+			res += idx.data()[dim] * mStrides.data()[dim];
+		return (size_t)res;
 	}
-	
-	const Bin& operator[]( size_t idx ) const
+
+	Bin operator[]( size_t idx ) const
 	{
-		if( idx > mBins.size() )
+		if( idx >= Size() )
 			throw std::runtime_error( std::format( "operator[]: Out of bins bound {}", idx ) );
-		return mBins[idx];
+
+		Bin bin{ Idx( idx ), sfVec( Dims() ), sfVec( Dims() ) };
+		for( size_t dim = 0; dim < Dims(); dim++ )
+		{
+			const auto& [begin, end] = mEdges[dim][bin.mIdx.data()[dim]];
+			bin.mBegin.data()[dim] = begin;
+			bin.mEnd.data()[dim] = end;
+		}
+		return bin;
 	}
 
-	bool HitBinRange( sfVec value ) const
+	bool HitBinRange( const sfVec& value ) const
 	{
 		return GetBinIdxByValue( value ) != -1;
 	}
 
-	const Bin& GetBinByValue( sfVec value ) const
+	Bin GetBinByValue( const sfVec& value ) const
 	{
 		auto idx = GetBinIdxByValue( value );
 		if( idx == -1 )
 			throw std::runtime_error( std::format( "GetBinByvalue: Out of bins bound {}", value ) );
-		return mBins[idx];
+		return ( *this )[idx];
 	}
 
-	Bin& GetBinByValue( sfVec value )
+	int GetBinIdxByValue( const sfVec& value ) const
 	{
-		auto idx = GetBinIdxByValue( value );
-		if( idx == -1 )
-			throw std::runtime_error( std::format( "GetBinByvalue: Out of bins bound {}", value ) );
-		return mBins[idx];
+		int64_t flat_idx = 0;
+		for( size_t dim = 0; dim < Dims(); dim++ )
+		{
+			auto idx = GetDimIdx( value.data()[dim], dim );
+			if( idx == -1 )
+				return -1;
+			flat_idx += idx * mStrides.data()[dim];
+		}
+		return (int)flat_idx;
 	}
 
-	int GetBinIdxByValue( sfVec value ) const
+	// Flat bin indices of events [begin, end) into idxs, -1 if out of bins range.
+	// Goes column by column over contiguous memory
+	void GetBinIdxs( const EventsView& events, size_t begin, size_t end, int* idxs ) const
 	{
-		if( mCache.empty() )
-			CalculateCache();
-
-		siVec idx;
+		std::fill( idxs, idxs + ( end - begin ), 0 );
 		for( size_t dim = 0; dim < Dims(); dim++ )
 		{
-			auto ptr = std::ranges::lower_bound( mCache[dim], std::pair( value[dim], value[dim] ),
-												 []( std::pair<Float, Float> bin,
-												 std::pair<Float, Float> value )
-			{
-				return bin.first <= value.first;
-			} );
-
-			if( ptr == mCache[dim].end() )
-			{
-				auto last_id = mCache[dim].size() - 1;
-				if( value[dim] <= mCache[dim][last_id].second )
-					idx.push_back( last_id );
-				else
-					return -1;
-			}
+			if( mUniform )
+				AddDimIdxs( events.Col( dim ), begin, end, dim, idxs, [&]( Float x ) { return GetUniformDimIdx( x, dim ); } );
 			else
-			{
-				auto dist = std::distance( mCache[dim].begin(), ptr ) - 1;
-				idx.push_back( std::max( (int)dist, 0 ) );
-			}
+				AddDimIdxs( events.Col( dim ), begin, end, dim, idxs, [&]( Float x ) { return GetEdgesDimIdx( x, dim ); } );
 		}
-		return (int)FromMultidimentionalIdx( idx, mSize );
+	}
+
+	// Index along one dim, -1 if out of range
+	int64_t GetDimIdx( Float x, size_t dim ) const
+	{
+		return mUniform ? GetUniformDimIdx( x, dim ) : GetEdgesDimIdx( x, dim );
+	}
+
+	// Index along one dim of static binning, -1 if out of range.
+	// Same result as the binary search over mEdges, O(1)
+	int64_t GetUniformDimIdx( Float x, size_t dim ) const
+	{
+		auto min = mUniform->mMin.data()[dim];
+		auto step = mUniform->mStep.data()[dim];
+		auto last = (int64_t)mSize.data()[dim] - 1;
+		auto begin = [&]( int64_t i ) { return min + step * (Float)i; };
+
+		// Negative and NaN go to the first bin as with lower_bound
+		Float pos = ( x - min ) / step;
+		int64_t idx = 0;
+		if( pos >= (Float)last )
+			idx = last;
+		else if( pos >= 0 )
+			idx = (int64_t)pos;
+
+		// Fix rounding at edges
+		while( idx < last && begin( idx + 1 ) <= x )
+			idx++;
+		while( idx > 0 && begin( idx ) > x )
+			idx--;
+
+		if( idx == last && begin( idx ) <= x && x > mUniform->mMax.data()[dim] )
+			return -1;
+		return idx;
+	}
+
+	// Last bin beginning not after x, values below the first one go to it
+	int64_t GetEdgesDimIdx( Float x, size_t dim ) const
+	{
+		const auto& edges = mEdges[dim];
+		auto iter = std::ranges::upper_bound( edges, x, {}, []( const std::pair<Float, Float>& edge ) { return edge.first; } );
+		if( iter == edges.end() )
+			return x <= edges.back().second ? (int64_t)edges.size() - 1 : -1;
+		return std::max<int64_t>( std::distance( edges.begin(), iter ) - 1, 0 );
 	}
 
 private:
-	void CalculateCache() const
+	template <typename F>
+	void AddDimIdxs( const Float* col, size_t begin, size_t end, size_t dim, int* idxs, F dim_idx ) const
 	{
-		for( size_t dim = 0; dim < Dims(); dim++ )
-			mCache.push_back( std::vector<std::pair<Float,Float>>( mSize[dim] ) );
-		for( const auto& bin : mBins )
-			for( size_t dim = 0; dim < Dims(); dim++ )
-				mCache[dim][bin.mIdx[dim]] = { bin.mBegin[dim] , bin.mEnd[dim] };
+		auto stride = (int)mStrides.data()[dim];
+		for( size_t i = begin; i < end; i++ )
+		{
+			auto& idx = idxs[i - begin];
+			if( idx == -1 )
+				continue;
+			auto idx_in_dim = dim_idx( col[i] );
+			idx = idx_in_dim == -1 ? -1 : idx + (int)idx_in_dim * stride;
+		}
 	}
 };
 
-Bins CalculateBins( std::span<sfVec> sim,
-					std::span<sfVec> exp,
+Bins CalculateBins( const EventsView& sim,
+					const EventsView& exp,
 					size_t dims,
 					size_t dims_shift,
 					BinningType type,
 					Int bins_count );
 
+// Binning from sketches of the shifted exp values and the shifted range of all values,
+// dynamic edges are estimated from the sketches ranks
+Bins CalculateBins( const std::vector<QuantileSketch>& exp_sketches,
+					const sfVec& min,
+					const sfVec& max,
+					BinningType type,
+					Int bins_count );
+
+// Shifted events with exp values of every dim sorted once. Binnings of event subsets,
+// as k-fold training sets, filter the order instead of sorting again
+class SortedEvents
+{
+	EventsView mSim;
+	EventsView mExp;
+	// Event indices of every dim by exp value
+	std::vector<std::vector<uint32_t>> mOrder;
+
+public:
+	SortedEvents( const EventsView& sim, const EventsView& exp, size_t dims, size_t dims_shift );
+
+	const EventsView& Sim() const
+	{
+		return mSim;
+	}
+
+	const EventsView& Exp() const
+	{
+		return mExp;
+	}
+
+	// Order of the dim without the events [exclude_begin, exclude_end)
+	std::vector<uint32_t> Order( size_t dim, size_t exclude_begin, size_t exclude_end ) const;
+};
+
+// Binning of the events outside [exclude_begin, exclude_end),
+// same edges as CalculateBins of them up to rounding at static edges
+Bins CalculateBins( const SortedEvents& events,
+					size_t exclude_begin,
+					size_t exclude_end,
+					BinningType type,
+					Int bins_count );
+
 inline sfVec ShiftDimTransform( const sfVec& vec,
 								size_t dims,
 								size_t shift_dims )
 {
 	sfVec res( dims );
 	for( size_t i = 0; i < dims; i++ )
-		res[i] = vec[( i + shift_dims ) % vec.size()];
+		res.data()[i] = vec.data()[( i + shift_dims ) % vec.size()];
 	return res;
 }
 
@@ -216,36 +295,6 @@ inline std::pair<sfVec, sfVec> ShiftDimTransform( const std::pair<sfVec, sfVec>&
 	return { f, s };
 }
 
-inline size_t MultiDimPow( siVec md_size, size_t dim )
-{
-	size_t res = 1;
-	for( size_t i = 0; i < dim; i++ )
-		res *= md_size[i];
-	return res;
-}
-
-inline siVec ToMultidimentionalIdx( size_t flat_idx,
-									size_t dims,
-									size_t dim_size )
-{
-	siVec res( dims );
-	size_t i = 0;
-	while( flat_idx != 0 )
-	{
-		res[i++] = flat_idx % dim_size;
-		flat_idx /= dim_size;
-	}
-	return res;
-}
-
-inline size_t FromMultidimentionalIdx( siVec idx, siVec md_size )
-{
-	size_t res = 0;
-	for( size_t i = 0; i < idx.size(); i++ )
-		res += idx[i] * MultiDimPow( md_size, i );
-	return res;
-}
-
 
 struct BinningProjection1D
 {
@@ -256,34 +305,6 @@ struct BinningProjection1D
 };
 using BinningProjections1D = std::vector<BinningProjection1D>;
 
-inline BinningProjections1D Caclucate1DBinningProjections( const Bins& bins )
-{
-	BinningProjections1D projections;
-	for( size_t dim = 0; dim < bins.Dims(); dim++ )
-	{
-		projections.push_back( { std::vector<Float>( bins.mSize[dim] ),
-	  						     std::vector<Float>( bins.mSize[dim] ),
-							     std::vector<Float>( bins.mSize[dim] ),
-							     std::vector<Float>( bins.mSize[dim] ) } );
-	}
-	for( const auto& bin : bins )
-	{
-		for( size_t dim = 0; dim < bins.Dims(); dim++ )
-		{
-			projections[dim].bin_width[bin.mIdx[dim]] = ( bin.mEnd[dim] - bin.mBegin[dim] ) / 2;
-			projections[dim].bin_xs[bin.mIdx[dim]] = ( bin.mEnd[dim] + bin.mBegin[dim] ) / 2;
-			projections[dim].sim_ys[bin.mIdx[dim]] += bin.Size();
-			for( const auto& sim_exp : bin )
-			{
-				auto md_idx = bins.GetBinByValue( sim_exp.second ).mIdx;
-				projections[dim].exp_ys[md_idx[dim]]++;
-			}
-		}
-	}
-	return projections;
-}
-
-
 struct BinningProjection2D
 {
 	int x_size;
@@ -292,24 +313,3 @@ struct BinningProjection2D
 	std::vector<int> hmap;
 };
 using BinningProjections2D = std::vector<BinningProjection2D>;
-
-inline BinningProjections2D Caclucate2DBinningProjections( const Bins& bins )
-{
-	BinningProjections2D projections;
-	for( size_t dim = 0; dim < bins.Dims(); dim++ )
-	{
-		BinningProjection2D projection;
-
-		projection.second_dim = int( ( dim + 1 ) % bins.Dims() );
-		projection.x_size = (int)bins.mSize[dim];
-		projection.y_size = (int)bins.mSize[projection.second_dim];
-
-		projection.hmap.resize( projection.x_size * projection.y_size );
-		for( const auto& bin : bins )
-			projection.hmap[bin.mIdx[dim] * projection.x_size + bin.mIdx[projection.second_dim]] += (int)bin.Size();
-
-		projections.push_back( std::move( projection ) );
-	}
-	return projections;
-}
-
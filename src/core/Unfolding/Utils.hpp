@@ -14,6 +14,8 @@
 #include <format>
 #include <span>
 #include <cstdlib>
+#include <cmath>
+#include <new>
 
 // ============== Consts ============== 
 
@@ -24,6 +26,41 @@ constexpr size_t MAX_VEC_SIZE = 3;
 
 // ============== Types ============== 
 
+// Keeps column arrays on cache line boundaries for vectorized loops
+template <typename T, size_t Alignment = 64>
+struct AlignedAllocator
+{
+	using value_type = T;
+
+	template <typename U>
+	struct rebind
+	{
+		using other = AlignedAllocator<U, Alignment>;
+	};
+
+	AlignedAllocator() = default;
+	template <typename U>
+	AlignedAllocator( const AlignedAllocator<U, Alignment>& ) {}
+
+	T* allocate( size_t size )
+	{
+		return static_cast<T*>( ::operator new( size * sizeof( T ), std::align_val_t( Alignment ) ) );
+	}
+
+	void deallocate( T* ptr, size_t )
+	{
+		::operator delete( ptr, std::align_val_t( Alignment ) );
+	}
+
+	bool operator==( const AlignedAllocator& ) const
+	{
+		return true;
+	}
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
 using dfMat = alglib::real_2d_array;
 using dfVec = alglib::real_1d_array;
 using sfVec = Vector<Float, MAX_VEC_SIZE>;
@@ -202,6 +239,14 @@ inline dfMat MatInverse( dfMat mat )
 	return mat;
 }
 
+inline Float MeanSquaredError( const dfVec& solution, const dfVec& truth )
+{
+	Float mse = 0;
+	for( int i = 0; i < solution.length(); i++ )
+		mse += std::pow( solution[i] - truth[i], 2 );
+	return mse / (Float)solution.length();
+}
+
 // ============== Strings ============== 
 
 inline Float ParseFloat( const std::string& str )
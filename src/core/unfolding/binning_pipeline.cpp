@@ -0,0 +1,340 @@
+#include "binning_pipeline.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+
+// Events are looked up in blocks, indices stay on the stack
+constexpr size_t LOOKUP_BLOCK_SIZE = 1024;
+
+struct ChunkStats
+{
+	std::vector<uint32_t> mExpCounts;
+	std::vector<uint32_t> mSimCounts;
+	// sim bin << 32 | exp bin of the migrated events, counted when the chunk is done
+	std::vector<uint64_t> mMigrationKeys;
+	std::vector<Migration> mMigrations;
+	std::vector<sfVec> mExpSums;
+};
+
+// Runs of equal sorted keys are the counts
+std::vector<Migration> CountMigrations( std::vector<uint64_t>& keys )
+{
+	std::ranges::sort( keys );
+	std::vector<Migration> res;
+	for( size_t i = 0; i < keys.size(); )
+	{
+		auto end = i;
+		while( end < keys.size() && keys[end] == keys[i] )
+			end++;
+		res.push_back( { uint32_t( keys[i] >> 32 ), uint32_t( keys[i] ), Float( end - i ) } );
+		i = end;
+	}
+	return res;
+}
+
+// Both are sorted, counts of the same bins are added
+void MergeMigrations( std::vector<Migration>& into, const std::vector<Migration>& from )
+{
+	auto key = []( const Migration& migration ) { return uint64_t( migration.mSimBin ) << 32 | migration.mExpBin; };
+	std::vector<Migration> res;
+	res.reserve( into.size() + from.size() );
+	size_t i = 0;
+	size_t j = 0;
+	while( i < into.size() || j < from.size() )
+	{
+		if( j == from.size() || ( i < into.size() && key( into[i] ) < key( from[j] ) ) )
+			res.push_back( into[i++] );
+		else if( i == into.size() || key( from[j] ) < key( into[i] ) )
+			res.push_back( from[j++] );
+		else
+		{
+			res.push_back( into[i++] );
+			res.back().mCount += from[j++].mCount;
+		}
+	}
+	into = std::move( res );
+}
+
+void CalculateProjections( const Bins& bins, BinningStats& stats )
+{
+	for( size_t dim = 0; dim < bins.Dims(); dim++ )
+	{
+		auto size = (size_t)bins.mSize[dim];
+		stats.mProjections1D.push_back( { std::vector<Float>( size ),
+										  std::vector<Float>( size ),
+										  std::vector<Float>( size ),
+										  std::vector<Float>( size ) } );
+
+		BinningProjection2D projection;
+		projection.second_dim = int( ( dim + 1 ) % bins.Dims() );
+		projection.x_size = (int)bins.mSize[dim];
+		projection.y_size = (int)bins.mSize[projection.second_dim];
+		projection.hmap.resize( projection.x_size * projection.y_size );
+		stats.mProjections2D.push_back( std::move( projection ) );
+	}
+
+	for( size_t dim = 0; dim < bins.Dims(); dim++ )
+	{
+		auto& projection1d = stats.mProjections1D[dim];
+		for( size_t idx = 0; idx < bins.mEdges[dim].size(); idx++ )
+		{
+			auto [begin, end] = bins.mEdges[dim][idx];
+			projection1d.bin_width[idx] = ( end - begin ) / 2;
+			projection1d.bin_xs[idx] = ( end + begin ) / 2;
+		}
+	}
+
+	for( size_t i = 0; i < bins.Size(); i++ )
+	{
+		for( size_t dim = 0; dim < bins.Dims(); dim++ )
+		{
+			auto& projection1d = stats.mProjections1D[dim];
+			auto idx = bins.DimIdx( i, dim );
+			projection1d.sim_ys[idx] += stats.mExpCounts[i];
+			projection1d.exp_ys[idx] += stats.mSimCounts[i];
+
+			auto& projection2d = stats.mProjections2D[dim];
+			projection2d.hmap[idx * projection2d.x_size + bins.DimIdx( i, projection2d.second_dim )] += (int)stats.mExpCounts[i];
+		}
+	}
+}
+
+} // namespace
+
+BinningStats CreateBinningStats( const Bins& bins )
+{
+	auto size = bins.Size();
+	BinningStats stats;
+	stats.mSize = size;
+	stats.mExpCounts.resize( size );
+	stats.mSimCounts.resize( size );
+	stats.mExpSums.resize( size, sfVec( bins.Dims() ) );
+	return stats;
+}
+
+void FinishBinningStats( const Bins& bins, BinningStats& stats )
+{
+	stats.mProjections1D.clear();
+	stats.mProjections2D.clear();
+	CalculateProjections( bins, stats );
+}
+
+BinningStats CalculateBinningStats( const Bins& bins,
+									const EventsView& sim,
+									const EventsView& exp,
+									size_t dim_shift )
+{
+	auto stats = CreateBinningStats( bins );
+	AccumulateBinningStats( stats, bins, sim, exp, dim_shift );
+	FinishBinningStats( bins, stats );
+	return stats;
+}
+
+void AccumulateBinningStats( BinningStats& stats,
+							 const Bins& bins,
+							 const EventsView& sim,
+							 const EventsView& exp,
+							 size_t dim_shift )
+{
+	auto size = bins.Size();
+	auto dims = bins.Dims();
+	auto shifted_sim = sim.ShiftDims( dims, dim_shift );
+	auto shifted_exp = exp.ShiftDims( dims, dim_shift );
+	auto chunks = ChunksCount( exp.Size() );
+	std::vector<ChunkStats> chunk_stats( chunks );
+
+	ParallelChunks( exp.Size(), chunks, [&]( size_t begin, size_t end, size_t chunk )
+	{
+		auto& stats = chunk_stats[chunk];
+		stats.mExpCounts.resize( size );
+		stats.mSimCounts.resize( size );
+		stats.mExpSums.resize( size, sfVec( dims ) );
+
+		int exp_idxs[LOOKUP_BLOCK_SIZE];
+		int sim_idxs[LOOKUP_BLOCK_SIZE];
+		for( size_t block = begin; block < end; block += LOOKUP_BLOCK_SIZE )
+		{
+			auto block_end = std::min( block + LOOKUP_BLOCK_SIZE, end );
+			bins.GetBinIdxs( shifted_exp, block, block_end, exp_idxs );
+			bins.GetBinIdxs( shifted_sim, block, block_end, sim_idxs );
+
+			for( size_t i = block; i < block_end; i++ )
+			{
+				auto exp_idx = exp_idxs[i - block];
+				if( exp_idx == -1 )
+					continue;
+				stats.mExpCounts[exp_idx]++;
+				auto* sum = stats.mExpSums[exp_idx].data();
+				for( size_t dim = 0; dim < dims; dim++ )
+					sum[dim] += shifted_exp( i, dim );
+
+				auto sim_idx = sim_idxs[i - block];
+				if( sim_idx == -1 )
+					continue;
+				stats.mSimCounts[sim_idx]++;
+				stats.mMigrationKeys.push_back( uint64_t( sim_idx ) << 32 | uint32_t( exp_idx ) );
+			}
+		}
+		stats.mMigrations = CountMigrations( stats.mMigrationKeys );
+		stats.mMigrationKeys = {};
+	} );
+
+	// Counts are integers, so reduction order doesn't change them
+	for( const auto& chunk : chunk_stats )
+	{
+		if( chunk.mExpCounts.empty() )
+			continue;
+		for( size_t i = 0; i < size; i++ )
+		{
+			stats.mExpCounts[i] += chunk.mExpCounts[i];
+			stats.mSimCounts[i] += chunk.mSimCounts[i];
+			for( size_t dim = 0; dim < dims; dim++ )
+				stats.mExpSums[i].data()[dim] += chunk.mExpSums[i].data()[dim];
+		}
+		MergeMigrations( stats.mMigrations, chunk.mMigrations );
+	}
+}
+
+std::pair<dfVec, dfVec> CalculateHistograms( const Bins& bins,
+											 const EventsView& sim,
+											 const EventsView& exp,
+											 size_t dim_shift )
+{
+	dfVec sim_hist;
+	dfVec exp_hist;
+	sim_hist.setlength( bins.Size() );
+	exp_hist.setlength( bins.Size() );
+	for( size_t i = 0; i < bins.Size(); i++ )
+	{
+		sim_hist[i] = 0;
+		exp_hist[i] = 0;
+	}
+	AccumulateHistograms( sim_hist, exp_hist, bins, sim, exp, dim_shift );
+	return { sim_hist, exp_hist };
+}
+
+void AccumulateHistograms( dfVec& sim_hist,
+						   dfVec& exp_hist,
+						   const Bins& bins,
+						   const EventsView& sim,
+						   const EventsView& exp,
+						   size_t dim_shift )
+{
+	auto size = bins.Size();
+	auto dims = bins.Dims();
+	auto shifted_sim = sim.ShiftDims( dims, dim_shift );
+	auto shifted_exp = exp.ShiftDims( dims, dim_shift );
+	auto chunks = ChunksCount( exp.Size() );
+	std::vector<std::vector<uint32_t>> chunk_sim( chunks, std::vector<uint32_t>( size ) );
+	std::vector<std::vector<uint32_t>> chunk_exp( chunks, std::vector<uint32_t>( size ) );
+
+	ParallelChunks( exp.Size(), chunks, [&]( size_t begin, size_t end, size_t chunk )
+	{
+		int idxs[LOOKUP_BLOCK_SIZE];
+		auto count = [&]( const EventsView& events, std::vector<uint32_t>& hist, size_t block, size_t block_end )
+		{
+			bins.GetBinIdxs( events, block, block_end, idxs );
+			for( size_t i = 0; i < block_end - block; i++ )
+				if( idxs[i] != -1 )
+					hist[idxs[i]]++;
+		};
+
+		for( size_t block = begin; block < end; block += LOOKUP_BLOCK_SIZE )
+		{
+			auto block_end = std::min( block + LOOKUP_BLOCK_SIZE, end );
+			count( shifted_sim, chunk_sim[chunk], block, block_end );
+			count( shifted_exp, chunk_exp[chunk], block, block_end );
+		}
+	} );
+
+	for( size_t i = 0; i < size; i++ )
+	{
+		for( size_t chunk = 0; chunk < chunks; chunk++ )
+		{
+			sim_hist[i] += chunk_sim[chunk][i];
+			exp_hist[i] += chunk_exp[chunk][i];
+		}
+	}
+}
+
+StreamingBinning StreamBinning( const std::string& path,
+								size_t dims,
+								size_t dim_shift,
+								BinningType type,
+								Int bins_count,
+								size_t chunk_size )
+{
+	StreamingBinning res;
+	auto rows = CountRows( path, chunk_size );
+	res.mTrainingSize = ( rows + 1 ) / 2;
+	res.mTestingSize = rows - res.mTrainingSize;
+
+	auto check_dims = [&]( const InputData& chunk )
+	{
+		auto max_dims = chunk.mSim.Dims();
+		if( dims < 1 || dims > max_dims )
+			throw std::runtime_error( std::format( "Dims must be in [1, {}]", max_dims ) );
+		if( dim_shift >= max_dims )
+			throw std::runtime_error( std::format( "Dim shift must be in [0, {}]", max_dims - 1 ) );
+	};
+
+	// Range and exp sketches of the training events
+	sfVec min( dims, std::numeric_limits<Float>::max() );
+	sfVec max( dims, -std::numeric_limits<Float>::max() );
+	std::vector<QuantileSketch> sketches( dims );
+	StreamData( path, chunk_size, [&]( const InputData& chunk, size_t first_row )
+	{
+		check_dims( chunk );
+		auto count = std::min( chunk.mSim.Size(), res.mTrainingSize - first_row );
+		auto sim = chunk.mSim.ShiftDims( dims, dim_shift );
+		auto exp = chunk.mExp.ShiftDims( dims, dim_shift );
+		ParallelChunks( dims, dims, [&]( size_t begin, size_t end, size_t )
+		{
+			for( size_t dim = begin; dim < end; dim++ )
+			{
+				const auto* sim_col = sim.Col( dim );
+				const auto* exp_col = exp.Col( dim );
+				for( size_t i = 0; i < count; i++ )
+				{
+					min[dim] = std::min( std::min( sim_col[i], exp_col[i] ), min[dim] );
+					max[dim] = std::max( std::max( sim_col[i], exp_col[i] ), max[dim] );
+					sketches[dim].Insert( exp_col[i] );
+				}
+			}
+		} );
+		return first_row + chunk.mSim.Size() < res.mTrainingSize;
+	} );
+	res.mBins = CalculateBins( sketches, min, max, type, bins_count );
+
+	// Counts of both halves in one more pass
+	auto size = res.mBins.Size();
+	res.mStats = CreateBinningStats( res.mBins );
+	res.mSimTestHist.setlength( size );
+	res.mExpTestHist.setlength( size );
+	for( size_t i = 0; i < size; i++ )
+	{
+		res.mSimTestHist[i] = 0;
+		res.mExpTestHist[i] = 0;
+	}
+	StreamData( path, chunk_size, [&]( const InputData& chunk, size_t first_row )
+	{
+		auto training = std::min( chunk.mSim.Size(), res.mTrainingSize - std::min( first_row, res.mTrainingSize ) );
+		AccumulateBinningStats( res.mStats,
+								res.mBins,
+								chunk.mSim.Subview( 0, training ),
+								chunk.mExp.Subview( 0, training ),
+								dim_shift );
+		AccumulateHistograms( res.mSimTestHist,
+							  res.mExpTestHist,
+							  res.mBins,
+							  chunk.mSim.Subview( training, chunk.mSim.Size() ),
+							  chunk.mExp.Subview( training, chunk.mExp.Size() ),
+							  dim_shift );
+		return true;
+	} );
+	FinishBinningStats( res.mBins, res.mStats );
+	return res;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "bin.hpp"
+
+#include <algorithm>
+#include <span>
+#include <vector>
+
+// Training events of the exp bin measured in the sim bin
+struct Migration
+{
+	uint32_t mSimBin = 0;
+	uint32_t mExpBin = 0;
+	Float mCount = 0;
+};
+
+// Everything rebinning needs from the training events.
+// Filled by one streaming pass once the bin edges are known,
+// exp values define the bin, sim values are the measured ones.
+struct BinningStats
+{
+	size_t mSize = 0;
+	std::vector<Float> mExpCounts;
+	std::vector<Float> mSimCounts;
+	// Nonzero migrations sorted by sim bin, then exp bin. An exp bin migrates
+	// to few sim bins, so they take O( bins ) memory instead of O( bins^2 )
+	std::vector<Migration> mMigrations;
+	// Sum of exp values in the bin
+	std::vector<sfVec> mExpSums;
+	BinningProjections1D mProjections1D;
+	BinningProjections2D mProjections2D;
+
+	Float MigrationCount( size_t sim_bin, size_t exp_bin ) const
+	{
+		auto it = std::ranges::lower_bound( mMigrations, std::pair( sim_bin, exp_bin ), {}, []( const Migration& migration )
+		{
+			return std::pair<size_t, size_t>( migration.mSimBin, migration.mExpBin );
+		} );
+		return it != mMigrations.end() && it->mSimBin == sim_bin && it->mExpBin == exp_bin ? it->mCount : 0;
+	}
+
+	sfVec MassCenter( size_t bin ) const
+	{
+		auto sum = mExpSums[bin];
+		return sum / ( mExpCounts[bin] + 1 );
+	}
+};
+
+BinningStats CalculateBinningStats( const Bins& bins,
+									const EventsView& sim,
+									const EventsView& exp,
+									size_t dim_shift );
+
+// Stats of events coming in parts: create, accumulate every part, finish
+BinningStats CreateBinningStats( const Bins& bins );
+
+void AccumulateBinningStats( BinningStats& stats,
+							 const Bins& bins,
+							 const EventsView& sim,
+							 const EventsView& exp,
+							 size_t dim_shift );
+
+// Projections of the accumulated counts
+void FinishBinningStats( const Bins& bins, BinningStats& stats );
+
+// sim and exp histograms of the testing events in one pass
+std::pair<dfVec, dfVec> CalculateHistograms( const Bins& bins,
+											 const EventsView& sim,
+											 const EventsView& exp,
+											 size_t dim_shift );
+
+void AccumulateHistograms( dfVec& sim_hist,
+						   dfVec& exp_hist,
+						   const Bins& bins,
+						   const EventsView& sim,
+						   const EventsView& exp,
+						   size_t dim_shift );
+
+// Result of binning a data file too big for memory
+struct StreamingBinning
+{
+	Bins mBins;
+	BinningStats mStats;
+	dfVec mSimTestHist;
+	dfVec mExpTestHist;
+	size_t mTrainingSize = 0;
+	size_t mTestingSize = 0;
+};
+
+// Reads the file in chunks of chunk_size bytes, so memory doesn't depend on its size.
+// Same training/testing halves as SplitData. Static edges come from the streamed range,
+// dynamic ones from quantile sketches of the training exp values
+StreamingBinning StreamBinning( const std::string& path,
+								size_t dims,
+								size_t dim_shift,
+								BinningType type,
+								Int bins_count,
+								size_t chunk_size = STREAM_CHUNK_SIZE );
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "utils.hpp"
+#include "binning_pipeline.hpp"
+#include "thread_pool.hpp"
+
+#include <cmath>
+#include <format>
+#include <random>
+#include <vector>
+
+constexpr size_t BOOTSTRAP_DEFAULT_REPLICAS = 100;
+constexpr uint64_t BOOTSTRAP_DEFAULT_SEED = 1;
+
+struct BootstrapResult
+{
+	size_t mReplicas = 0;
+	dfVec mMean;
+	// Spread of the replicas around their mean
+	dfVec mRms;
+	// Mean minus truth
+	dfVec mBias;
+	// Share of replicas with the truth inside solution +- rms
+	dfVec mCoverage;
+};
+
+// Poisson bootstrap gives every event a Poisson( 1 ) weight, so a bin of n events gets Poisson( n )
+inline Float PoissonFluctuate( Float count, std::mt19937_64& rng )
+{
+	if( count <= 0 )
+		return 0;
+	return (Float)std::poisson_distribution<int64_t>( count )( rng );
+}
+
+inline dfVec FluctuateHistogram( const dfVec& hist, std::mt19937_64& rng )
+{
+	dfVec res;
+	res.setlength( hist.length() );
+	for( int i = 0; i < hist.length(); i++ )
+		res[i] = PoissonFluctuate( hist[i], rng );
+	return res;
+}
+
+// Only the migrations are filled, the migration mat doesn't need the rest.
+// Empty bins stay empty, so only the nonzero migrations are fluctuated
+inline BinningStats FluctuateMigration( const BinningStats& stats, std::mt19937_64& rng )
+{
+	BinningStats res;
+	res.mSize = stats.mSize;
+	res.mMigrations = stats.mMigrations;
+	for( auto& migration : res.mMigrations )
+		migration.mCount = PoissonFluctuate( migration.mCount, rng );
+	return res;
+}
+
+// Unfolds Poisson replicas of the measured histogram m, and of the migration counts if
+// fluctuate_migration, with the binning fixed. solve( migration, m ) unfolds one replica,
+// migration is nullptr for the original stats, so the solver decomposition can be reused.
+// Replicas run in parallel, each one has its own random stream seeded by ( seed, replica ),
+// so the result doesn't depend on threads count
+template <typename F>
+BootstrapResult RunBootstrap( const BinningStats& stats,
+							  const dfVec& m,
+							  const dfVec& truth,
+							  size_t replicas,
+							  bool fluctuate_migration,
+							  uint64_t seed,
+							  F&& solve )
+{
+	if( replicas < 2 )
+		throw std::runtime_error( std::format( "Bootstrap needs at least 2 replicas, got {}", replicas ) );
+	if( truth.length() != m.length() )
+		throw std::runtime_error( std::format( "Bootstrap: Invalid truth size {}, m size {}", truth.length(), m.length() ) );
+
+	std::vector<dfVec> solutions( replicas );
+	ParallelChunks( replicas, ChunksCount( replicas, 1 ), [&]( size_t begin, size_t end, size_t )
+	{
+		for( size_t replica = begin; replica < end; replica++ )
+		{
+			std::seed_seq seeds{ seed >> 32, seed & 0xffffffff, (uint64_t)replica };
+			std::mt19937_64 rng( seeds );
+			auto replica_m = FluctuateHistogram( m, rng );
+			if( fluctuate_migration )
+			{
+				auto migration = FluctuateMigration( stats, rng );
+				solutions[replica] = solve( &migration, replica_m );
+			}
+			else
+				solutions[replica] = solve( nullptr, replica_m );
+		}
+	} );
+
+	// Reduced in replicas order, same sums for any threads count
+	auto size = m.length();
+	BootstrapResult res;
+	res.mReplicas = replicas;
+	res.mMean.setlength( size );
+	res.mRms.setlength( size );
+	res.mBias.setlength( size );
+	res.mCoverage.setlength( size );
+	for( int i = 0; i < size; i++ )
+	{
+		Float sum = 0;
+		for( const auto& solution : solutions )
+			sum += solution[i];
+		res.mMean[i] = sum / (Float)replicas;
+
+		Float sqr_sum = 0;
+		for( const auto& solution : solutions )
+			sqr_sum += std::pow( solution[i] - res.mMean[i], 2 );
+		res.mRms[i] = std::sqrt( sqr_sum / Float( replicas - 1 ) );
+		res.mBias[i] = res.mMean[i] - truth[i];
+
+		size_t covered = 0;
+		for( const auto& solution : solutions )
+			covered += std::abs( solution[i] - truth[i] ) <= res.mRms[i];
+		res.mCoverage[i] = (Float)covered / (Float)replicas;
+	}
+	return res;
+}
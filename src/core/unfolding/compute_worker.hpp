@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Thrown from JobContext::Check when a newer job was posted
+struct JobCancelled
+{
+};
+
+class JobContext
+{
+	const std::atomic<bool>& mCancelled;
+	std::atomic<float>& mProgress;
+
+public:
+	JobContext( const std::atomic<bool>& cancelled, std::atomic<float>& progress )
+		: mCancelled( cancelled )
+		, mProgress( progress )
+	{
+	}
+
+	bool Cancelled() const
+	{
+		return mCancelled;
+	}
+
+	// Checkpoint between job stages, progress is in [0, 1]
+	void Check( float progress ) const
+	{
+		if( mCancelled )
+			throw JobCancelled{};
+		mProgress = progress;
+	}
+};
+
+// Runs jobs one by one on a dedicated thread.
+// A posted job supersedes the pending one and cancels the running one
+// at its next checkpoint, so only the latest request is finished
+class ComputeWorker
+{
+	using Job = std::function<void( const JobContext& )>;
+
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	Job mPending;
+	std::atomic<bool> mCancelled = false;
+	std::atomic<float> mProgress = 0;
+	bool mRunning = false;
+	bool mStop = false;
+	std::thread mThread;
+
+public:
+	ComputeWorker()
+		: mThread( [this] { Run(); } )
+	{
+	}
+
+	~ComputeWorker()
+	{
+		{
+			std::lock_guard lock( mMutex );
+			mStop = true;
+			mPending = nullptr;
+			mCancelled = true;
+		}
+		mCondition.notify_all();
+		mThread.join();
+	}
+
+	ComputeWorker( const ComputeWorker& ) = delete;
+	ComputeWorker& operator=( const ComputeWorker& ) = delete;
+
+	void Post( Job job )
+	{
+		{
+			std::lock_guard lock( mMutex );
+			mPending = std::move( job );
+			mCancelled = mRunning;
+		}
+		mCondition.notify_all();
+	}
+
+	// Drops the pending job and waits for the running one to stop
+	void Cancel()
+	{
+		std::unique_lock lock( mMutex );
+		mPending = nullptr;
+		mCancelled = mRunning;
+		mCondition.wait( lock, [this] { return !mRunning; } );
+	}
+
+	bool Busy()
+	{
+		std::lock_guard lock( mMutex );
+		return mRunning || mPending;
+	}
+
+	// Progress of the running job
+	float Progress() const
+	{
+		return mProgress;
+	}
+
+private:
+	void Run()
+	{
+		while( true )
+		{
+			Job job;
+			{
+				std::unique_lock lock( mMutex );
+				mCondition.wait( lock, [this] { return mStop || mPending; } );
+				if( mStop )
+					return;
+				job = std::move( mPending );
+				mPending = nullptr;
+				mCancelled = false;
+				mProgress = 0;
+				mRunning = true;
+			}
+
+			try
+			{
+				job( JobContext( mCancelled, mProgress ) );
+			}
+			catch( const JobCancelled& )
+			{
+			}
+			catch( const std::exception& e )
+			{
+				std::cerr << e.what() << std::endl;
+			}
+
+			{
+				std::lock_guard lock( mMutex );
+				mRunning = false;
+			}
+			mCondition.notify_all();
+		}
+	}
+};
@@ -0,0 +1,52 @@
+#include "cross_validation.hpp"
+#include "thread_pool.hpp"
+
+#include <cmath>
+
+CrossValidation RunCrossValidation( const EventsView& sim,
+									const EventsView& exp,
+									size_t dims,
+									size_t dim_shift,
+									BinningType type,
+									Int bins_count,
+									size_t folds,
+									const FoldSolver& solve )
+{
+	auto size = exp.Size();
+	if( folds < 2 || folds > size )
+		throw std::runtime_error( std::format( "Folds count must be in [2, {}], got {}", size, folds ) );
+
+	SortedEvents sorted( sim, exp, dims, dim_shift );
+	CrossValidation res;
+	res.mFolds.resize( folds );
+	ParallelChunks( folds, ChunksCount( folds, 1 ), [&]( size_t begin, size_t end, size_t )
+	{
+		for( size_t fold = begin; fold < end; fold++ )
+		{
+			auto test_begin = size * fold / folds;
+			auto test_end = size * ( fold + 1 ) / folds;
+			auto bins = CalculateBins( sorted, test_begin, test_end, type, bins_count );
+
+			// Training events are the parts before and after the testing ones
+			auto stats = CreateBinningStats( bins );
+			AccumulateBinningStats( stats, bins, sim.Subview( 0, test_begin ), exp.Subview( 0, test_begin ), dim_shift );
+			AccumulateBinningStats( stats, bins, sim.Subview( test_end, size ), exp.Subview( test_end, size ), dim_shift );
+			FinishBinningStats( bins, stats );
+			auto [sim_hist, exp_hist] = CalculateHistograms( bins,
+															 sim.Subview( test_begin, test_end - test_begin ),
+															 exp.Subview( test_begin, test_end - test_begin ),
+															 dim_shift );
+
+			auto solution = solve( bins, stats, sim_hist );
+			res.mFolds[fold] = { test_begin, test_end, bins.Size(), MeanSquaredError( solution, exp_hist ) };
+		}
+	} );
+
+	for( const auto& fold : res.mFolds )
+		res.mMeanMse += fold.mMse;
+	res.mMeanMse /= (Float)folds;
+	for( const auto& fold : res.mFolds )
+		res.mMseRms += std::pow( fold.mMse - res.mMeanMse, 2 );
+	res.mMseRms = std::sqrt( res.mMseRms / Float( folds - 1 ) );
+	return res;
+}
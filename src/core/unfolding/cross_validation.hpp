@@ -0,0 +1,43 @@
+#pragma once
+
+#include "bin.hpp"
+#include "binning_pipeline.hpp"
+
+#include <functional>
+#include <vector>
+
+constexpr size_t CV_DEFAULT_FOLDS = 5;
+
+struct FoldResult
+{
+	// Testing events of the fold
+	size_t mBegin = 0;
+	size_t mEnd = 0;
+	size_t mBins = 0;
+	// Against the fold exp histogram
+	Float mMse = 0;
+};
+
+struct CrossValidation
+{
+	std::vector<FoldResult> mFolds;
+	Float mMeanMse = 0;
+	// Spread of the folds MSE
+	Float mMseRms = 0;
+};
+
+// solve( bins, stats, m ) unfolds the testing sim histogram m of a fold
+using FoldSolver = std::function<dfVec( const Bins&, const BinningStats&, const dfVec& )>;
+
+// k-fold cross validation: events are split into k contiguous folds and every fold is
+// the testing set once, the rest is the training set. Folds are ranges of the views, so
+// nothing is copied, and exp values are sorted once for the binnings of all folds.
+// Folds run in parallel
+CrossValidation RunCrossValidation( const EventsView& sim,
+									const EventsView& exp,
+									size_t dims,
+									size_t dim_shift,
+									BinningType type,
+									Int bins_count,
+									size_t folds,
+									const FoldSolver& solve );
@@ -0,0 +1,161 @@
+
+#include "data_cache.hpp"
+#include "thread_pool.hpp"
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+
+namespace
+{
+
+constexpr char MAGIC[8] = { 'U', 'N', 'F', 'C', 'O', 'L', 'S', '1' };
+constexpr size_t ALIGNMENT = 64;
+constexpr size_t CHECKSUM_BLOCK_SIZE = 1 << 22;
+
+struct Header
+{
+	char mMagic[8];
+	uint64_t mChecksum;
+	uint64_t mSourceSize;
+	uint64_t mRows;
+	uint32_t mCols;
+	uint32_t mFloatSize;
+};
+
+size_t AlignUp( size_t offset )
+{
+	return ( offset + ALIGNMENT - 1 ) / ALIGNMENT * ALIGNMENT;
+}
+
+// FNV-1a over 8 byte words
+uint64_t BlockHash( std::string_view data )
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	size_t i = 0;
+	for( ; i + 8 <= data.size(); i += 8 )
+	{
+		uint64_t word;
+		std::memcpy( &word, data.data() + i, 8 );
+		hash = ( hash ^ word ) * 0x100000001b3ull;
+	}
+	for( ; i < data.size(); i++ )
+		hash = ( hash ^ (uint8_t)data[i] ) * 0x100000001b3ull;
+	return hash;
+}
+
+} // namespace
+
+std::string DataCachePath( const std::string& source_path )
+{
+	return source_path + ".cols";
+}
+
+uint64_t DataChecksum( std::string_view data )
+{
+	auto blocks = ( data.size() + CHECKSUM_BLOCK_SIZE - 1 ) / CHECKSUM_BLOCK_SIZE;
+	std::vector<uint64_t> hashes( blocks );
+	ParallelChunks( blocks, ChunksCount( blocks, 1 ), [&]( size_t begin, size_t end, size_t )
+	{
+		for( size_t block = begin; block < end; block++ )
+			hashes[block] = BlockHash( data.substr( block * CHECKSUM_BLOCK_SIZE, CHECKSUM_BLOCK_SIZE ) );
+	} );
+
+	uint64_t hash = 0xcbf29ce484222325ull ^ data.size();
+	for( auto block_hash : hashes )
+		hash = ( hash ^ block_hash ) * 0x100000001b3ull;
+	return hash;
+}
+
+std::optional<DataCache> ReadDataCache( const std::string& path, uint64_t checksum, size_t source_size )
+{
+	if constexpr( std::endian::native != std::endian::little )
+		return std::nullopt;
+	if( !std::filesystem::exists( path ) )
+		return std::nullopt;
+
+	auto file = std::make_shared<const MappedFile>( path );
+	auto data = file->View();
+	Header header;
+	if( data.size() < sizeof( header ) )
+		return std::nullopt;
+	std::memcpy( &header, data.data(), sizeof( header ) );
+	if( std::memcmp( header.mMagic, MAGIC, sizeof( MAGIC ) ) != 0 ||
+		header.mChecksum != checksum ||
+		header.mSourceSize != source_size ||
+		header.mFloatSize != sizeof( Float ) )
+		return std::nullopt;
+
+	DataCache cache;
+	size_t offset = sizeof( header );
+	for( uint32_t i = 0; i < header.mCols; i++ )
+	{
+		uint32_t length;
+		if( offset + sizeof( length ) > data.size() )
+			return std::nullopt;
+		std::memcpy( &length, data.data() + offset, sizeof( length ) );
+		offset += sizeof( length );
+		if( offset + length > data.size() )
+			return std::nullopt;
+		cache.mCols.emplace_back( std::string( data.substr( offset, length ) ) );
+		offset += length;
+	}
+
+	for( auto& col : cache.mCols )
+	{
+		offset = AlignUp( offset );
+		if( offset + header.mRows * sizeof( Float ) > data.size() )
+			return std::nullopt;
+		col.mMapped = std::span( reinterpret_cast<const Float*>( data.data() + offset ), header.mRows );
+		offset += header.mRows * sizeof( Float );
+	}
+	cache.mFile = std::move( file );
+	return cache;
+}
+
+void WriteDataCache( const std::string& path, uint64_t checksum, size_t source_size, const std::vector<Column>& cols )
+{
+	if constexpr( std::endian::native != std::endian::little )
+		return;
+
+	Header header;
+	std::memcpy( header.mMagic, MAGIC, sizeof( MAGIC ) );
+	header.mChecksum = checksum;
+	header.mSourceSize = source_size;
+	header.mRows = cols.empty() ? 0 : cols.front().Values().size();
+	header.mCols = (uint32_t)cols.size();
+	header.mFloatSize = sizeof( Float );
+
+	// Written aside and renamed, so readers never see a partial cache
+	auto tmp_path = path + ".tmp";
+	{
+		std::ofstream file( tmp_path, std::ios::binary | std::ios::trunc );
+		if( !file )
+			throw std::runtime_error( std::format( "Can't create data cache {}", tmp_path ) );
+
+		size_t offset = 0;
+		auto write = [&]( const void* data, size_t size )
+		{
+			file.write( static_cast<const char*>( data ), (std::streamsize)size );
+			offset += size;
+		};
+		const char zeros[ALIGNMENT] = {};
+
+		write( &header, sizeof( header ) );
+		for( const auto& col : cols )
+		{
+			auto length = (uint32_t)col.mName.size();
+			write( &length, sizeof( length ) );
+			write( col.mName.data(), length );
+		}
+		for( const auto& col : cols )
+		{
+			write( zeros, AlignUp( offset ) - offset );
+			write( col.Values().data(), col.Values().size_bytes() );
+		}
+		if( !file )
+			throw std::runtime_error( std::format( "Can't write data cache {}", tmp_path ) );
+	}
+	std::filesystem::rename( tmp_path, path );
+}
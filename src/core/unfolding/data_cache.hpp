@@ -0,0 +1,30 @@
+#pragma once
+
+#include "load_data.hpp"
+#include "mapped_file.hpp"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Binary columnar sidecar of a parsed text file, stored next to it.
+// Layout, little endian:
+//   magic, source checksum, source size, rows, columns count, float size,
+//   names as ( u32 length, bytes ), then every column array aligned to 64 bytes
+struct DataCache
+{
+	std::shared_ptr<const MappedFile> mFile;
+	// Values point into mFile
+	std::vector<Column> mCols;
+};
+
+std::string DataCachePath( const std::string& source_path );
+
+// Hash of fixed size blocks combined in order, doesn't depend on threads count
+uint64_t DataChecksum( std::string_view data );
+
+// Empty if there is no cache or it was made from another source
+std::optional<DataCache> ReadDataCache( const std::string& path, uint64_t checksum, size_t source_size );
+
+void WriteDataCache( const std::string& path, uint64_t checksum, size_t source_size, const std::vector<Column>& cols );
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "utils.hpp"
+#include "sparse_mat.hpp"
+
+#include <iostream>
+
+// Number of iterations is the regularization, few of them keep the prior shape
+constexpr size_t ITERATIVE_DEFAULT_ITERATIONS = 4;
+constexpr size_t ITERATIVE_MAX_ITERATIONS = 1000;
+// Relative L1 change of the solution to stop at, 0 runs all iterations
+constexpr Float ITERATIVE_DEFAULT_TOLERANCE = 1e-4;
+
+enum class UnfoldingMethod
+{
+	Tikhonov,
+	Iterative
+};
+
+// D'Agostini iterative Bayesian unfolding, Richardson-Lucy deconvolution for histograms.
+// A is the migration mat [sim bin][exp bin], columns are P( sim bin | exp bin ).
+// Every iteration folds the current solution and moves it by the measured/folded ratios:
+//   tau_j = tau_j / eff_j * sum_i A_ij m_i / ( A tau )_i
+// which is two products with A. Starts from a flat prior of the measured total
+inline dfVec SolveIterative( const CsrMat& A, const dfVec& m, size_t iterations, Float tolerance, bool debug )
+{
+	auto size = A.Cols();
+
+	dfVec ones;
+	ones.setlength( A.Rows() );
+	for( size_t i = 0; i < A.Rows(); i++ )
+		ones[i] = 1;
+	auto efficiencies = A.MulTransposed( ones );
+
+	Float total = 0;
+	for( int i = 0; i < m.length(); i++ )
+		total += m[i];
+	dfVec tau;
+	tau.setlength( size );
+	for( size_t j = 0; j < size; j++ )
+		tau[j] = efficiencies[j] > 0 ? total / (Float)size : 0;
+
+	dfVec ratios;
+	ratios.setlength( A.Rows() );
+	size_t iteration = 0;
+	Float change = 0;
+	while( iteration < std::min( iterations, ITERATIVE_MAX_ITERATIONS ) )
+	{
+		iteration++;
+		auto folded = A.Mul( tau );
+		for( size_t i = 0; i < A.Rows(); i++ )
+			ratios[i] = folded[i] > 0 ? m[i] / folded[i] : 0;
+		auto corrections = A.MulTransposed( ratios );
+
+		Float diff = 0;
+		Float norm = 0;
+		for( size_t j = 0; j < size; j++ )
+		{
+			auto next = efficiencies[j] > 0 ? tau[j] * corrections[j] / efficiencies[j] : 0;
+			diff += std::abs( next - tau[j] );
+			norm += std::abs( next );
+			tau[j] = next;
+		}
+		change = norm > 0 ? diff / norm : 0;
+		if( change < tolerance )
+			break;
+	}
+
+	if( debug )
+		std::cout << std::format( "Iterative unfolding iterations {} change {}\n", iteration, change )
+				  << "tau\n" << tau << "\n\n";
+	return tau;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "bin.hpp"
+#include "migration_mat.hpp"
+#include "system_solver.hpp"
+
+#include <optional>
+
+// Derived linear algebra products of the current binning.
+// Each entry remembers the binning version it was calculated for,
+// so values are recalculated only after Invalidate() (rebinning).
+class LinAlgCache
+{
+	template <typename T>
+	struct Entry
+	{
+		T mValue;
+		size_t mVersion = 0;
+		std::optional<NeighborsMatType> mType;
+	};
+
+	size_t mVersion = 1;
+	Entry<dfMat> mMigrationMat;
+	Entry<dfVec> mSingularValues;
+	Entry<dfMat> mNeighborsMat;
+	Entry<TikhonovSolver> mSolver;
+	Entry<CsrMat> mMigrationCsr;
+	Entry<CsrMat> mNeighborsCsr;
+
+public:
+	void Invalidate()
+	{
+		mVersion++;
+	}
+
+	size_t Version() const
+	{
+		return mVersion;
+	}
+
+	const dfMat& MigrationMat( const BinningStats& stats )
+	{
+		if( mMigrationMat.mVersion != mVersion )
+		{
+			mMigrationMat.mValue = CalculateMigrationMat( stats );
+			mMigrationMat.mVersion = mVersion;
+		}
+		return mMigrationMat.mValue;
+	}
+
+	// Job type 0: U and Vt are not calculated
+	const dfVec& SingularValues( const BinningStats& stats )
+	{
+		if( mSingularValues.mVersion != mVersion )
+		{
+			mSingularValues.mValue = ::SingularValues( MigrationMat( stats ) );
+			mSingularValues.mVersion = mVersion;
+		}
+		return mSingularValues.mValue;
+	}
+
+	const dfMat& NeighborsMat( const Bins& bins, const BinningStats& stats, NeighborsMatType type )
+	{
+		if( mNeighborsMat.mVersion != mVersion || mNeighborsMat.mType != type )
+		{
+			mNeighborsMat.mValue = CalculateNeighborsMat( bins, stats, type );
+			mNeighborsMat.mVersion = mVersion;
+			mNeighborsMat.mType = type;
+		}
+		return mNeighborsMat.mValue;
+	}
+
+	const CsrMat& MigrationCsr( const BinningStats& stats )
+	{
+		if( mMigrationCsr.mVersion != mVersion )
+		{
+			mMigrationCsr.mValue = CalculateMigrationCsr( stats );
+			mMigrationCsr.mVersion = mVersion;
+		}
+		return mMigrationCsr.mValue;
+	}
+
+	// Fluctuated C for the sparse solver
+	const CsrMat& NeighborsCsr( const Bins& bins, const BinningStats& stats, NeighborsMatType type )
+	{
+		if( mNeighborsCsr.mVersion != mVersion || mNeighborsCsr.mType != type )
+		{
+			mNeighborsCsr.mValue = FluctuateMat( CalculateNeighborsCsr( bins, stats, type ) );
+			mNeighborsCsr.mVersion = mVersion;
+			mNeighborsCsr.mType = type;
+		}
+		return mNeighborsCsr.mValue;
+	}
+
+	// Decomposition shared by every alpha
+	const TikhonovSolver& Solver( const Bins& bins, const BinningStats& stats, NeighborsMatType type, bool debug )
+	{
+		if( mSolver.mVersion != mVersion || mSolver.mType != type )
+		{
+			mSolver.mValue = TikhonovSolver( MigrationMat( stats ), FluctuateMat( NeighborsMat( bins, stats, type ) ), debug );
+			mSolver.mVersion = mVersion;
+			mSolver.mType = type;
+		}
+		return mSolver.mValue;
+	}
+};
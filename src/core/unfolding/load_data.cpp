@@ -1,40 +1,288 @@
 
 #include "load_data.hpp"
+#include "mapped_file.hpp"
+#include "data_cache.hpp"
+#include "thread_pool.hpp"
 #include <format>
+#include <charconv>
+#include <cstring>
 #include <ranges>
 #include <algorithm>
 
-InputData LoadData( std::vector<std::string> files )
+namespace
 {
-	InputData data;
 
-	// Parse cols
-	for( const auto& path : files )
+// Minimal bytes amount worth a separate parsing task
+constexpr size_t MIN_PARSE_CHUNK_SIZE = 1 << 20;
+
+const char* SkipBlanks( const char* ptr, const char* end )
+{
+	while( ptr != end && ( *ptr == ' ' || *ptr == '\t' ) )
+		ptr++;
+	return ptr;
+}
+
+// Parses comma separated rows in place, straight into the columns from row first_row.
+// Columns must be big enough, empty lines are skipped. Returns rows count
+size_t ParseRows( std::string_view text,
+				  std::vector<Column>& cols,
+				  size_t first_row,
+				  const std::string& path,
+				  size_t first_line )
+{
+	std::vector<Float*> dst;
+	for( auto& col : cols )
+		dst.push_back( col.mData.data() );
+
+	const char* ptr = text.data();
+	const char* end = ptr + text.size();
+	size_t row = first_row;
+	for( size_t line = first_line; ptr != end; line++ )
+	{
+		auto* line_end = static_cast<const char*>( std::memchr( ptr, '\n', end - ptr ) );
+		if( !line_end )
+			line_end = end;
+		auto* content_end = line_end;
+		if( content_end != ptr && content_end[-1] == '\r' )
+			content_end--;
+
+		if( SkipBlanks( ptr, content_end ) != content_end )
+		{
+			for( size_t col = 0; col < dst.size(); col++ )
+			{
+				ptr = SkipBlanks( ptr, content_end );
+				if( ptr != content_end && *ptr == '+' )
+					ptr++;
+
+				Float value;
+				auto [next, ec] = std::from_chars( ptr, content_end, value );
+				if( ec != std::errc() )
+					throw std::runtime_error( std::format( "Invalid value in {} line {}", path, line ) );
+				dst[col][row] = value;
+
+				ptr = SkipBlanks( next, content_end );
+				bool last = col + 1 == dst.size();
+				if( last ? ptr != content_end : ( ptr == content_end || *ptr != ',' ) )
+					throw std::runtime_error( std::format( "Expected {} values in {} line {}", dst.size(), path, line ) );
+				if( !last )
+					ptr++;
+			}
+			row++;
+		}
+		ptr = line_end == end ? end : line_end + 1;
+	}
+	return row - first_row;
+}
+
+std::vector<Column> ParseHeader( std::string_view header )
+{
+	std::vector<Column> cols;
+	for( auto name : Split( header, ","sv ) )
+		cols.emplace_back( std::string( Trim( name ) ) );
+	return cols;
+}
+
+// Parses rows in newline aligned byte ranges on the thread pool, returns rows count
+size_t ParseBody( std::string_view body, std::vector<Column>& cols, const std::string& path, size_t first_line )
+{
+	auto chunks = ChunksCount( body.size(), MIN_PARSE_CHUNK_SIZE );
+	std::vector<size_t> bounds{ 0 };
+	for( size_t chunk = 1; chunk < chunks; chunk++ )
+	{
+		auto pos = body.find( '\n', std::max( body.size() * chunk / chunks, bounds.back() ) );
+		bounds.push_back( pos == std::string_view::npos ? body.size() : pos + 1 );
+	}
+	bounds.push_back( body.size() );
+	auto chunk_text = [&]( size_t chunk )
+	{
+		return body.substr( bounds[chunk], bounds[chunk + 1] - bounds[chunk] );
+	};
+
+	// lines[chunk] is the lines count before the chunk,
+	// it is an upper bound of rows before the chunk
+	std::vector<size_t> lines( chunks + 1 );
+	ParallelChunks( chunks, chunks, [&]( size_t begin, size_t end, size_t )
+	{
+		for( size_t chunk = begin; chunk < end; chunk++ )
+			lines[chunk + 1] = (size_t)std::ranges::count( chunk_text( chunk ), '\n' );
+	} );
+	for( size_t chunk = 0; chunk < chunks; chunk++ )
+		lines[chunk + 1] += lines[chunk];
+
+	for( auto& col : cols )
+		col.mData.resize( lines[chunks] + 1 );
+
+	std::vector<size_t> rows( chunks );
+	ParallelChunks( chunks, chunks, [&]( size_t begin, size_t end, size_t )
+	{
+		for( size_t chunk = begin; chunk < end; chunk++ )
+			rows[chunk] = ParseRows( chunk_text( chunk ), cols, lines[chunk], path, first_line + lines[chunk] );
+	} );
+
+	// Close gaps left by empty lines
+	size_t size = 0;
+	for( size_t chunk = 0; chunk < chunks; chunk++ )
 	{
-		std::ifstream file( path );
-		std::string column_names;
-		std::getline( file, column_names );
+		if( lines[chunk] != size )
+			for( auto& col : cols )
+				std::copy_n( col.mData.begin() + lines[chunk], rows[chunk], col.mData.begin() + size );
+		size += rows[chunk];
+	}
+	for( auto& col : cols )
+		col.mData.resize( size );
+	return size;
+}
 
-		std::vector<Column> file_columns;
-		for( auto name : Split( column_names, ","sv ) )
-			file_columns.emplace_back( Column{ std::string( Trim( name ) ) } );
+std::vector<Column> ParseFile( const std::string& path, std::string_view text )
+{
+	auto header_end = std::min( text.find( '\n' ), text.size() );
+	auto cols = ParseHeader( text.substr( 0, header_end ) );
+	ParseBody( text.substr( std::min( header_end + 1, text.size() ) ), cols, path, 2 );
+	return cols;
+}
+
+// Reads the file body in newline aligned chunks of about chunk_size bytes,
+// func( header, chunk, first_line ) gets every chunk
+template <typename F>
+void ReadChunks( const std::string& path, size_t chunk_size, F&& func )
+{
+	std::ifstream file( path, std::ios::binary );
+	if( !file )
+		throw std::runtime_error( std::format( "Can't open data file {}", path ) );
+	std::string header;
+	std::getline( file, header );
 
-		for( std::string line; std::getline( file, line ); )
+	std::vector<char> buffer( std::max<size_t>( chunk_size, 1 ) );
+	size_t filled = 0;
+	size_t line = 2;
+	while( true )
+	{
+		file.read( buffer.data() + filled, (std::streamsize)( buffer.size() - filled ) );
+		filled += (size_t)file.gcount();
+		bool eof = !file;
+
+		std::string_view text( buffer.data(), filled );
+		auto last_line_end = text.rfind( '\n' );
+		if( !eof && last_line_end == std::string_view::npos )
 		{
-			int i = 0;
-			for( auto value : Split( line, ","sv ) )
-				file_columns[i++].mData.push_back( ParseFloat( std::string( Trim( value ) ) ) );
+			// Line is longer than the buffer
+			buffer.resize( buffer.size() * 2 );
+			continue;
 		}
-		data.mCols.insert( data.mCols.end(), 
-						   std::move_iterator( file_columns.begin() ),
-						   std::move_iterator( file_columns.end() ) );
+		auto chunk = eof ? text : text.substr( 0, last_line_end + 1 );
+		func( std::string_view( header ), chunk, line );
+		line += (size_t)std::ranges::count( chunk, '\n' );
+
+		std::memmove( buffer.data(), buffer.data() + chunk.size(), filled - chunk.size() );
+		filled -= chunk.size();
+		if( eof )
+			break;
 	}
+}
 
-	// Convert cols into rows
-	std::vector<Column*> sim_cols;
-	std::vector<Column*> exp_cols;
-	for( auto& col : data.mCols )
+// Columns of the file, from its data cache when it is fresh
+DataCache LoadFile( const std::string& path )
+{
+	MappedFile file( path );
+	auto text = file.View();
+	auto checksum = DataChecksum( text );
+	auto cache_path = DataCachePath( path );
+	try
 	{
+		if( auto cache = ReadDataCache( cache_path, checksum, text.size() ) )
+			return std::move( *cache );
+	}
+	catch( const std::exception& e )
+	{
+		std::cerr << e.what() << std::endl;
+	}
+
+	DataCache res;
+	res.mCols = ParseFile( path, text );
+	try
+	{
+		WriteDataCache( cache_path, checksum, text.size(), res.mCols );
+	}
+	catch( const std::exception& e )
+	{
+		std::cerr << e.what() << std::endl;
+	}
+	return res;
+}
+
+} // namespace
+
+InputData LoadData( std::vector<std::string> files )
+{
+	// Files are loaded concurrently
+	std::vector<DataCache> file_data( files.size() );
+	ParallelChunks( files.size(), files.size(), [&]( size_t begin, size_t end, size_t )
+	{
+		for( size_t i = begin; i < end; i++ )
+			file_data[i] = LoadFile( files[i] );
+	} );
+
+	std::vector<Column> cols;
+	std::vector<std::shared_ptr<const MappedFile>> mappings;
+	for( auto& file : file_data )
+	{
+		cols.insert( cols.end(),
+					 std::move_iterator( file.mCols.begin() ),
+					 std::move_iterator( file.mCols.end() ) );
+		if( file.mFile )
+			mappings.push_back( std::move( file.mFile ) );
+	}
+
+	auto data = CreateInputData( std::move( cols ) );
+	data.mMappings = std::move( mappings );
+	return data;
+}
+
+size_t CountRows( const std::string& path, size_t chunk_size )
+{
+	size_t rows = 0;
+	ReadChunks( path, chunk_size, [&]( std::string_view, std::string_view chunk, size_t )
+	{
+		for( size_t begin = 0; begin < chunk.size(); )
+		{
+			auto end = std::min( chunk.find( '\n', begin ), chunk.size() );
+			if( !Trim( chunk.substr( begin, end - begin ) ).empty() )
+				rows++;
+			begin = end + 1;
+		}
+	} );
+	return rows;
+}
+
+void StreamData( const std::string& path,
+				 size_t chunk_size,
+				 const std::function<bool( const InputData& chunk, size_t first_row )>& func )
+{
+	size_t row = 0;
+	bool stop = false;
+	ReadChunks( path, chunk_size, [&]( std::string_view header, std::string_view chunk, size_t first_line )
+	{
+		if( stop )
+			return;
+		auto cols = ParseHeader( header );
+		auto rows = ParseBody( chunk, cols, path, first_line );
+		stop = !func( CreateInputData( std::move( cols ) ), row );
+		row += rows;
+	} );
+}
+
+InputData CreateInputData( std::vector<Column> cols )
+{
+	InputData data;
+	data.mCols = std::move( cols );
+
+	std::vector<const Column*> sim_cols;
+	std::vector<const Column*> exp_cols;
+	for( const auto& col : data.mCols )
+	{
+		if( col.Values().size() != data.mCols.front().Values().size() )
+			throw std::runtime_error( std::format( "Column {} has {} values, expected {}",
+									  col.mName, col.Values().size(), data.mCols.front().Values().size() ) );
 		if( col.mName.ends_with( "sim" ) )
 			sim_cols.push_back( &col );
 		else
@@ -51,21 +299,7 @@ InputData LoadData( std::vector<std::string> files )
 	std::ranges::sort( sim_cols, sort_func );
 	std::ranges::sort( exp_cols, sort_func );
 
-	auto fill_rows = []( std::vector<Column*> cols ) -> Rows
-	{
-		Rows rows;
-		for( const auto* col : cols )
-			rows.mNames.push_back( col->mName );
-		for( size_t i = 0; i < cols.front()->mData.size(); i++ )
-		{
-			sfVec row;
-			for( const auto* col : cols )
-				row.push_back( col->mData[i] );
-			rows.mData.push_back( std::move( row ) );
-		}
-		return rows;
-	};
-	data.mSim = fill_rows( sim_cols );
-	data.mExp = fill_rows( exp_cols );
+	data.mSim = EventsView( sim_cols );
+	data.mExp = EventsView( exp_cols );
 	return data;
 }
\ No newline at end of file
@@ -3,6 +3,9 @@
 #include "utils.hpp"
 
 #include <vector>
+#include <memory>
+#include <functional>
+#include <span>
 #include <string>
 #include <fstream>
 #include <string>
@@ -13,43 +16,127 @@ using namespace std::literals;
 struct Column
 {
 	std::string mName;
-	std::vector<Float> mData;
+	AlignedVector<Float> mData;
+	// Set instead of mData when values live in a mapped data cache
+	std::span<const Float> mMapped;
+
+	explicit Column( std::string name ) : mName( std::move( name ) ) {}
+
+	std::span<const Float> Values() const
+	{
+		return mMapped.data() ? mMapped : std::span<const Float>( mData );
+	}
 };
 
-struct Rows
+// Columnar view of events, column i holds dim i of every event
+class EventsView
 {
-	std::vector<std::string> mNames;
-	std::vector<sfVec> mData;
+	std::array<const Float*, MAX_VEC_SIZE> mCols{};
+	size_t mDims = 0;
+	size_t mSize = 0;
 
-	const sfVec& operator[]( size_t idx ) const
+public:
+	EventsView() = default;
+	explicit EventsView( const std::vector<const Column*>& cols )
 	{
-		return mData[idx];
+		if( cols.size() > MAX_VEC_SIZE )
+			throw std::runtime_error( std::format( "Too many columns {}, max is {}", cols.size(), MAX_VEC_SIZE ) );
+		mDims = cols.size();
+		mSize = cols.empty() ? 0 : cols.front()->Values().size();
+		for( size_t dim = 0; dim < mDims; dim++ )
+			mCols[dim] = cols[dim]->Values().data();
 	}
-	auto begin()
+
+	Float operator()( size_t idx, size_t dim ) const
 	{
-		return mData.begin();
+		return mCols[dim][idx];
 	}
-	auto end()
+
+	sfVec operator[]( size_t idx ) const
 	{
-		return mData.end();
+		sfVec row( mDims );
+		for( size_t dim = 0; dim < mDims; dim++ )
+			row.data()[dim] = mCols[dim][idx];
+		return row;
 	}
-	size_t Dim() const
+
+	const Float* Col( size_t dim ) const
 	{
-		if( mData.size() == 0 )
-			throw std::runtime_error( "Can't determine dimension for empty Rows" );
-		return mData.front().size();
+		return mCols[dim];
 	}
+
+	size_t Dims() const
+	{
+		return mDims;
+	}
+
 	size_t Size() const
 	{
-		return mData.size();
+		return mSize;
+	}
+
+	EventsView Subview( size_t offset, size_t count ) const
+	{
+		EventsView res = *this;
+		offset = std::min( offset, mSize );
+		res.mSize = std::min( count, mSize - offset );
+		for( size_t dim = 0; dim < mDims; dim++ )
+			res.mCols[dim] += offset;
+		return res;
+	}
+
+	// First dims columns starting from shift_dims, same as ShiftDimTransform on every row
+	EventsView ShiftDims( size_t dims, size_t shift_dims ) const
+	{
+		EventsView res = *this;
+		res.mDims = dims;
+		for( size_t dim = 0; dim < dims; dim++ )
+			res.mCols[dim] = mCols[( dim + shift_dims ) % mDims];
+		return res;
 	}
 };
 
+inline std::vector<EventsView> SplitData( const EventsView& events, size_t parts )
+{
+	std::vector<EventsView> res;
+	auto part_size = size_t( std::ceil( (Float)events.Size() / parts ) );
+	for( size_t i = 0; i < parts; i++ )
+		res.push_back( events.Subview( i * part_size, part_size ) );
+	return res;
+}
+
+class MappedFile;
+
+// Owns the columns, sim and exp are views into them
 struct InputData
 {
 	std::vector<Column> mCols;
-	Rows mSim;
-	Rows mExp;
+	// Data caches the mapped columns point into
+	std::vector<std::shared_ptr<const MappedFile>> mMappings;
+	EventsView mSim;
+	EventsView mExp;
+
+	InputData() = default;
+	InputData( InputData&& ) = default;
+	InputData& operator=( InputData&& ) = default;
+	InputData( const InputData& ) = delete;
+	InputData& operator=( const InputData& ) = delete;
 };
 
-InputData LoadData( std::vector<std::string> files );
\ No newline at end of file
+// Columns named *sim are sim values, others are exp
+InputData CreateInputData( std::vector<Column> cols );
+
+// Text files are parsed once, later loads map their binary data cache
+InputData LoadData( std::vector<std::string> files );
+
+// Text bytes parsed at once when streaming
+constexpr size_t STREAM_CHUNK_SIZE = 64 << 20;
+
+// Data rows of a text file, values are not parsed
+size_t CountRows( const std::string& path, size_t chunk_size = STREAM_CHUNK_SIZE );
+
+// Parses a text file chunk by chunk, only one chunk is in memory at once.
+// Stops when func returns false
+void StreamData( const std::string& path,
+				 size_t chunk_size,
+				 const std::function<bool( const InputData& chunk, size_t first_row )>& func );
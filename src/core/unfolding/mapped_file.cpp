@@ -0,0 +1,109 @@
+
+#include "mapped_file.hpp"
+#include <format>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile( const std::string& path )
+{
+	mFile = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+						 OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+	if( mFile == INVALID_HANDLE_VALUE )
+	{
+		mFile = nullptr;
+		throw std::runtime_error( std::format( "Can't open data file {}", path ) );
+	}
+
+	LARGE_INTEGER size;
+	if( !GetFileSizeEx( mFile, &size ) )
+	{
+		Close();
+		throw std::runtime_error( std::format( "Can't get size of data file {}", path ) );
+	}
+	mSize = (size_t)size.QuadPart;
+	// Empty files can't be mapped
+	if( mSize == 0 )
+		return;
+
+	mMapping = CreateFileMappingA( mFile, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	if( mMapping )
+		mData = static_cast<const char*>( MapViewOfFile( mMapping, FILE_MAP_READ, 0, 0, 0 ) );
+	if( !mData )
+	{
+		Close();
+		throw std::runtime_error( std::format( "Can't map data file {}", path ) );
+	}
+}
+
+void MappedFile::Close()
+{
+	if( mData )
+		UnmapViewOfFile( mData );
+	if( mMapping )
+		CloseHandle( mMapping );
+	if( mFile )
+		CloseHandle( mFile );
+	mData = nullptr;
+	mMapping = nullptr;
+	mFile = nullptr;
+	mSize = 0;
+}
+
+#else
+
+MappedFile::MappedFile( const std::string& path )
+{
+	mFile = open( path.c_str(), O_RDONLY );
+	if( mFile == -1 )
+		throw std::runtime_error( std::format( "Can't open data file {}", path ) );
+
+	struct stat info;
+	if( fstat( mFile, &info ) == -1 )
+	{
+		Close();
+		throw std::runtime_error( std::format( "Can't get size of data file {}", path ) );
+	}
+	mSize = (size_t)info.st_size;
+	// Empty files can't be mapped
+	if( mSize == 0 )
+		return;
+
+	auto* data = mmap( nullptr, mSize, PROT_READ, MAP_PRIVATE, mFile, 0 );
+	if( data == MAP_FAILED )
+	{
+		Close();
+		throw std::runtime_error( std::format( "Can't map data file {}", path ) );
+	}
+	mData = static_cast<const char*>( data );
+	madvise( data, mSize, MADV_SEQUENTIAL );
+}
+
+void MappedFile::Close()
+{
+	if( mData )
+		munmap( const_cast<char*>( mData ), mSize );
+	if( mFile != -1 )
+		close( mFile );
+	mData = nullptr;
+	mFile = -1;
+	mSize = 0;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
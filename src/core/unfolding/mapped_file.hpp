@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Read-only memory mapping of a whole file
+class MappedFile
+{
+	const char* mData = nullptr;
+	size_t mSize = 0;
+#ifdef _WIN32
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+#else
+	int mFile = -1;
+#endif
+
+public:
+	explicit MappedFile( const std::string& path );
+	~MappedFile();
+
+	MappedFile( const MappedFile& ) = delete;
+	MappedFile& operator=( const MappedFile& ) = delete;
+
+	std::string_view View() const
+	{
+		return std::string_view( mData, mSize );
+	}
+
+	size_t Size() const
+	{
+		return mSize;
+	}
+
+private:
+	void Close();
+};
@@ -1,30 +1,45 @@
 #pragma once
 
 #include "bin.hpp"
-#include "load_data.hpp"
+#include "binning_pipeline.hpp"
+#include "sparse_mat.hpp"
 #include <format>
 
-inline dfMat CalculateMigrationMat( Bins& bins )
+// Training events of every exp bin, the migration mat columns are normalized by them
+inline std::vector<Float> MigrationAmounts( const BinningStats& stats )
 {
-	size_t mat_size = bins.mBins.size();
-	auto mat = CreateSqrMat( mat_size );
+	std::vector<Float> amounts( stats.mSize );
+	for( const auto& migration : stats.mMigrations )
+		amounts[migration.mExpBin] += migration.mCount;
+	return amounts;
+}
 
-	for( size_t i = 0; i < mat_size; i++ )
+inline dfMat CalculateMigrationMat( const BinningStats& stats )
+{
+	size_t mat_size = stats.mSize;
+	auto mat = CreateSqrMat( mat_size );
+	auto amounts = MigrationAmounts( stats );
+	for( const auto& migration : stats.mMigrations )
 	{
-		auto& bin = bins.mBins[i];
-		for( auto [sim, exp] : bin )
-		{
-			size_t exp_idx = FromMultidimentionalIdx( bins.GetBinByValue( exp ).mIdx, bins.mSize );
-			mat[exp_idx][i]++;
-		}
+		auto amount = amounts[migration.mExpBin];
+		mat[migration.mSimBin][migration.mExpBin] = migration.mCount / ( amount ? amount : 1.0 );
 	}
-	for( size_t j = 0; j < mat_size; j++ )
+	return mat;
+}
+
+// Same values as CalculateMigrationMat without the dense matrix, rows are the sim bins
+// the migrations are sorted by
+inline CsrMat CalculateMigrationCsr( const BinningStats& stats )
+{
+	auto amounts = MigrationAmounts( stats );
+	CsrMat mat( stats.mSize );
+	auto migration = stats.mMigrations.begin();
+	for( size_t i = 0; i < stats.mSize; i++ )
 	{
-		double amount = 0;
-		for( size_t i = 0; i < mat_size; i++ )
-			amount += mat[i][j];
-		for( size_t i = 0; i < mat_size; i++ )
-			mat[i][j] /= amount ? amount : 1.0;
+		for( ; migration != stats.mMigrations.end() && migration->mSimBin == i; migration++ )
+			if( migration->mCount )
+				mat.Add( migration->mExpBin, migration->mCount / ( amounts[migration->mExpBin] ? amounts[migration->mExpBin] : 1.0 ) );
+		mat.EndRow();
 	}
 	return mat;
-}
\ No newline at end of file
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "utils.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+constexpr size_t QUANTILE_SKETCH_CAPACITY = 4096;
+
+// Mergeable quantile summary with KLL style compaction, memory doesn't depend on values count.
+// A sample kept at level l stands for 2^l values, so the rank error is about log2( n / capacity ) / capacity.
+// Compaction offsets alternate instead of being random, so results are reproducible
+class QuantileSketch
+{
+	size_t mCapacity;
+	std::vector<std::vector<Float>> mLevels;
+	uint64_t mCount = 0;
+	uint64_t mCompactions = 0;
+
+public:
+	// Sorted samples with ranks, ranks are counts of values before the sample
+	class Cdf
+	{
+		std::vector<Float> mValues;
+		std::vector<uint64_t> mRanks;
+
+	public:
+		Cdf( std::vector<std::pair<Float, uint64_t>> samples )
+		{
+			std::ranges::sort( samples );
+			mRanks.push_back( 0 );
+			for( auto [value, weight] : samples )
+			{
+				mValues.push_back( value );
+				mRanks.push_back( mRanks.back() + weight );
+			}
+		}
+
+		// Exact cdf of sorted values
+		static Cdf FromSorted( std::vector<Float> values )
+		{
+			Cdf res( std::vector<std::pair<Float, uint64_t>>{} );
+			res.mValues = std::move( values );
+			res.mRanks.resize( res.mValues.size() + 1 );
+			std::iota( res.mRanks.begin(), res.mRanks.end(), uint64_t( 0 ) );
+			return res;
+		}
+
+		// Estimated count of values less than x
+		uint64_t Rank( Float x ) const
+		{
+			return mRanks[std::ranges::lower_bound( mValues, x ) - mValues.begin()];
+		}
+
+		// Estimated value with rank values before it
+		Float Value( uint64_t rank ) const
+		{
+			auto iter = std::upper_bound( mRanks.begin() + 1, mRanks.end(), rank );
+			auto idx = std::min<size_t>( iter - mRanks.begin() - 1, mValues.size() - 1 );
+			return mValues[idx];
+		}
+
+		uint64_t Count() const
+		{
+			return mRanks.back();
+		}
+	};
+
+	explicit QuantileSketch( size_t capacity = QUANTILE_SKETCH_CAPACITY )
+		: mCapacity( std::max<size_t>( capacity, 2 ) )
+		, mLevels( 1 )
+	{
+	}
+
+	void Insert( Float value )
+	{
+		mLevels[0].push_back( value );
+		mCount++;
+		if( mLevels[0].size() >= mCapacity )
+			Compact( 0 );
+	}
+
+	void Merge( const QuantileSketch& other )
+	{
+		if( mLevels.size() < other.mLevels.size() )
+			mLevels.resize( other.mLevels.size() );
+		for( size_t level = 0; level < other.mLevels.size(); level++ )
+			mLevels[level].insert( mLevels[level].end(), other.mLevels[level].begin(), other.mLevels[level].end() );
+		mCount += other.mCount;
+		for( size_t level = 0; level < mLevels.size(); level++ )
+			if( mLevels[level].size() >= mCapacity )
+				Compact( level );
+	}
+
+	uint64_t Count() const
+	{
+		return mCount;
+	}
+
+	Cdf CalculateCdf() const
+	{
+		std::vector<std::pair<Float, uint64_t>> samples;
+		for( size_t level = 0; level < mLevels.size(); level++ )
+			for( auto value : mLevels[level] )
+				samples.push_back( { value, uint64_t( 1 ) << level } );
+		return Cdf( std::move( samples ) );
+	}
+
+private:
+	// Every second sorted sample goes one level up with doubled weight
+	void Compact( size_t level )
+	{
+		if( level + 1 == mLevels.size() )
+			mLevels.emplace_back();
+		auto& buffer = mLevels[level];
+		auto& next = mLevels[level + 1];
+		std::ranges::sort( buffer );
+
+		// Odd sample stays, so weights sum is kept exactly
+		auto size = buffer.size() / 2 * 2;
+		for( size_t i = mCompactions++ % 2; i < size; i += 2 )
+			next.push_back( buffer[i] );
+		buffer.erase( buffer.begin(), buffer.begin() + size );
+
+		if( next.size() >= mCapacity )
+			Compact( level + 1 );
+	}
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "utils.hpp"
+
+#include <string>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+
+inline std::ofstream OpenOutputFile( const std::string& path )
+{
+	std::ofstream file( path );
+	if( !file )
+		throw std::runtime_error( std::format( "Can't open output file {}", path ) );
+	file << std::setprecision( std::numeric_limits<Float>::max_digits10 );
+	return file;
+}
+
+// One row per bin: bin, name0, name1, ...
+inline void SaveHistograms( const std::string& path,
+							const std::vector<std::string>& names,
+							const std::vector<const dfVec*>& hists )
+{
+	auto file = OpenOutputFile( path );
+	file << "bin";
+	for( const auto& name : names )
+		file << ", " << name;
+	file << "\n";
+
+	auto size = hists.empty() ? 0 : hists.front()->length();
+	for( int i = 0; i < size; i++ )
+	{
+		file << i;
+		for( const auto* hist : hists )
+			file << ", " << ( *hist )[i];
+		file << "\n";
+	}
+}
+
+inline void SaveMat( const std::string& path, const dfMat& mat )
+{
+	auto file = OpenOutputFile( path );
+	for( int i = 0; i < mat.rows(); i++ )
+	{
+		for( int j = 0; j < mat.cols(); j++ )
+			file << ( j ? ", " : "" ) << mat[i][j];
+		file << "\n";
+	}
+}
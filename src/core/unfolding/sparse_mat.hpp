@@ -0,0 +1,127 @@
+#pragma once
+
+#include "utils.hpp"
+#include "thread_pool.hpp"
+
+#include <vector>
+
+// Compressed sparse rows, filled row by row with Add() and EndRow()
+class CsrMat
+{
+	size_t mCols = 0;
+	std::vector<size_t> mRowBegins{ 0 };
+	std::vector<uint32_t> mColIdxs;
+	std::vector<Float> mValues;
+
+public:
+	CsrMat() = default;
+	explicit CsrMat( size_t cols )
+		: mCols( cols )
+	{
+	}
+
+	// Zeros are dropped except on the diagonal
+	static CsrMat FromDense( const dfMat& mat )
+	{
+		CsrMat res( mat.cols() );
+		for( int i = 0; i < mat.rows(); i++ )
+		{
+			for( int j = 0; j < mat.cols(); j++ )
+				if( mat[i][j] != 0 || i == j )
+					res.Add( j, mat[i][j] );
+			res.EndRow();
+		}
+		return res;
+	}
+
+	void Add( size_t col, Float value )
+	{
+		mColIdxs.push_back( (uint32_t)col );
+		mValues.push_back( value );
+	}
+
+	void EndRow()
+	{
+		mRowBegins.push_back( mValues.size() );
+	}
+
+	size_t Rows() const
+	{
+		return mRowBegins.size() - 1;
+	}
+
+	size_t Cols() const
+	{
+		return mCols;
+	}
+
+	size_t NonZeros() const
+	{
+		return mValues.size();
+	}
+
+	// Diagonal entries must be stored
+	void AddToDiagonal( Float value )
+	{
+		for( size_t i = 0; i < Rows(); i++ )
+		{
+			auto k = mRowBegins[i];
+			while( k < mRowBegins[i + 1] && mColIdxs[k] != i )
+				k++;
+			if( k == mRowBegins[i + 1] )
+				throw std::runtime_error( std::format( "CsrMat: No diagonal entry in row {}", i ) );
+			mValues[k] += value;
+		}
+	}
+
+	// mat * vec, rows are split between threads
+	dfVec Mul( const dfVec& vec ) const
+	{
+		if( (size_t)vec.length() != mCols )
+			throw std::runtime_error( std::format( "CsrMat: Invalid vec size {}, cols {}", vec.length(), mCols ) );
+
+		dfVec res;
+		res.setlength( Rows() );
+		ParallelChunks( Rows(), ChunksCount( NonZeros() ), [&]( size_t begin, size_t end, size_t )
+		{
+			for( size_t i = begin; i < end; i++ )
+			{
+				Float sum = 0;
+				for( size_t k = mRowBegins[i]; k < mRowBegins[i + 1]; k++ )
+					sum += mValues[k] * vec[mColIdxs[k]];
+				res[i] = sum;
+			}
+		} );
+		return res;
+	}
+
+	// mat^T * vec
+	dfVec MulTransposed( const dfVec& vec ) const
+	{
+		if( (size_t)vec.length() != Rows() )
+			throw std::runtime_error( std::format( "CsrMat: Invalid vec size {}, rows {}", vec.length(), Rows() ) );
+
+		dfVec res;
+		res.setlength( mCols );
+		for( size_t j = 0; j < mCols; j++ )
+			res[j] = 0;
+		for( size_t i = 0; i < Rows(); i++ )
+			for( size_t k = mRowBegins[i]; k < mRowBegins[i + 1]; k++ )
+				res[mColIdxs[k]] += mValues[k] * vec[i];
+		return res;
+	}
+
+	dfMat ToDense() const
+	{
+		dfMat res;
+		res.setlength( Rows(), mCols );
+		for( size_t i = 0; i < Rows(); i++ )
+		{
+			for( size_t j = 0; j < mCols; j++ )
+				res[i][j] = 0;
+			for( size_t k = mRowBegins[i]; k < mRowBegins[i + 1]; k++ )
+				res[i][mColIdxs[k]] = mValues[k];
+		}
+		return res;
+	}
+};
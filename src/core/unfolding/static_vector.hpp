@@ -57,6 +57,15 @@ public:
 	{
 		return mSize;
 	}
+	// Unchecked access for hot loops
+	T* data()
+	{
+		return mData.data();
+	}
+	const T* data() const
+	{
+		return mData.data();
+	}
 	auto begin()
 	{
 		return mData.begin();
@@ -126,14 +135,14 @@ public:
 		return !operator<=( other );
 	}
 
-	Vector<T, MaxSize> operator+( const Vector<T, MaxSize>& other )
+	Vector<T, MaxSize> operator+( const Vector<T, MaxSize>& other ) const
 	{
 		Vector<T, MaxSize> res( mSize );
 		for( size_t i = 0; i < mSize; i++ )
 			res[i] = mData[i] + other[i];
 		return res;
 	}
-	Vector<T, MaxSize> operator+( const T& value )
+	Vector<T, MaxSize> operator+( const T& value ) const
 	{
 		Vector<T, MaxSize> res( mSize );
 		for( size_t i = 0; i < mSize; i++ )
@@ -141,28 +150,28 @@ public:
 		return res;
 	}
 
-	Vector<T, MaxSize> operator*( const Vector<T, MaxSize>& other )
+	Vector<T, MaxSize> operator*( const Vector<T, MaxSize>& other ) const
 	{
 		Vector<T, MaxSize> res( mSize );
 		for( size_t i = 0; i < mSize; i++ )
 			res[i] = mData[i] * other[i];
 		return res;
 	}
-	Vector<T, MaxSize> operator-( const Vector<T, MaxSize>& other )
+	Vector<T, MaxSize> operator-( const Vector<T, MaxSize>& other ) const
 	{
 		Vector<T, MaxSize> res( mSize );
 		for( size_t i = 0; i < mSize; i++ )
 			res[i] = mData[i] - other[i];
 		return res;
 	}
-	Vector<T, MaxSize> operator/( const Vector<T, MaxSize>& other )
+	Vector<T, MaxSize> operator/( const Vector<T, MaxSize>& other ) const
 	{
 		Vector<T, MaxSize> res( mSize );
 		for( size_t i = 0; i < mSize; i++ )
 			res[i] = mData[i] / other[i];
 		return res;
 	}
-	Vector<T, MaxSize> operator/( T value )
+	Vector<T, MaxSize> operator/( T value ) const
 	{
 		Vector<T, MaxSize> res( mSize );
 		for( size_t i = 0; i < mSize; i++ )
@@ -171,7 +180,7 @@ public:
 	}
 
 	template <typename C>
-	Vector<C, MaxSize> cast()
+	Vector<C, MaxSize> cast() const
 	{
 		Vector<C, MaxSize> res( mSize );
 		for( size_t i = 0; i < mSize; i++ )
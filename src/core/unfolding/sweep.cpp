@@ -0,0 +1,167 @@
+#include "sweep.hpp"
+#include "migration_mat.hpp"
+#include "thread_pool.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <exception>
+#include <future>
+#include <limits>
+
+namespace
+{
+
+class Stopwatch
+{
+	std::chrono::steady_clock::time_point mBegin = std::chrono::steady_clock::now();
+
+public:
+	double Ms() const
+	{
+		return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - mBegin ).count();
+	}
+};
+
+// Every future is waited for before rethrowing, tasks reference the callers locals
+void WaitAll( ThreadPool& pool, std::vector<std::future<void>>& futures )
+{
+	std::exception_ptr error;
+	for( auto& future : futures )
+	{
+		try
+		{
+			pool.Wait( future );
+		}
+		catch( ... )
+		{
+			if( !error )
+				error = std::current_exception();
+		}
+	}
+	if( error )
+		std::rethrow_exception( error );
+}
+
+struct SweepBinning
+{
+	Bins mBins;
+	BinningStats mStats;
+	dfVec mSimTestHist;
+	dfVec mExpTestHist;
+	double mMs = 0;
+};
+
+// All alphas of one binning and neighbors type, rows are filled in the grid order
+void SolveAlphas( const SweepGrid& grid, const SweepBinning& binning, NeighborsMatType type, SweepRow* rows )
+{
+	Stopwatch decomposition;
+	auto size = binning.mBins.Size();
+	std::vector<dfVec> solutions( grid.mAlphas.size() );
+	std::vector<double> alphas( grid.mAlphas.size() );
+	std::vector<double> solve_ms( grid.mAlphas.size() );
+	double decomposition_ms = 0;
+	if( size >= SPARSE_SOLVER_MIN_BINS )
+	{
+		// No scan without the SVD, selected alphas are left NaN
+		auto migration_csr = CalculateMigrationCsr( binning.mStats );
+		auto neighbors_csr = FluctuateMat( CalculateNeighborsCsr( binning.mBins, binning.mStats, type ) );
+		decomposition_ms = decomposition.Ms();
+		for( size_t k = 0; k < grid.mAlphas.size(); k++ )
+		{
+			Stopwatch solve;
+			alphas[k] = grid.mAlphas[k].mSelection == AlphaSelection::Manual
+							? grid.mAlphas[k].mValue
+							: std::numeric_limits<double>::quiet_NaN();
+			if( !std::isnan( alphas[k] ) )
+				solutions[k] = SolveSparseSystem( migration_csr, neighbors_csr, binning.mSimTestHist, alphas[k], false );
+			solve_ms[k] = solve.Ms();
+		}
+	}
+	else
+	{
+		TikhonovSolver solver( CalculateMigrationMat( binning.mStats ),
+							   FluctuateMat( CalculateNeighborsMat( binning.mBins, binning.mStats, type ) ) );
+		AlphaScan scan;
+		for( const auto& alpha : grid.mAlphas )
+			if( alpha.mSelection != AlphaSelection::Manual )
+			{
+				scan = solver.ScanAlpha( binning.mSimTestHist );
+				break;
+			}
+		decomposition_ms = decomposition.Ms();
+		for( size_t k = 0; k < grid.mAlphas.size(); k++ )
+		{
+			Stopwatch solve;
+			alphas[k] = scan.Alpha( grid.mAlphas[k].mSelection, grid.mAlphas[k].mValue );
+			solutions[k] = solver.Solve( binning.mSimTestHist, alphas[k] );
+			solve_ms[k] = solve.Ms();
+		}
+	}
+
+	for( size_t k = 0; k < grid.mAlphas.size(); k++ )
+	{
+		auto& row = rows[k];
+		row.mAlphaRequest = grid.mAlphas[k];
+		row.mAlpha = alphas[k];
+		row.mBins = size;
+		row.mMse = solutions[k].length() ? MeanSquaredError( solutions[k], binning.mExpTestHist ) : std::numeric_limits<Float>::quiet_NaN();
+		row.mBinningMs = binning.mMs;
+		row.mDecompositionMs = decomposition_ms;
+		row.mSolveMs = solve_ms[k];
+	}
+}
+
+} // namespace
+
+std::vector<SweepRow> RunSweep( const EventsView& training_sim,
+								const EventsView& training_exp,
+								const EventsView& testing_sim,
+								const EventsView& testing_exp,
+								const SweepGrid& grid )
+{
+	auto alphas = grid.mAlphas.size();
+	auto per_binning = grid.mNeighborsMatTypes.size() * alphas;
+	std::vector<SweepRow> rows( grid.mBinningTypes.size() * grid.mBinsCounts.size() * grid.mDims.size() * per_binning );
+
+	auto& pool = ThreadPool::Global();
+	std::vector<std::future<void>> futures;
+	size_t row = 0;
+	for( auto binning_type : grid.mBinningTypes )
+		for( auto bins_count : grid.mBinsCounts )
+			for( auto dims : grid.mDims )
+			{
+				auto* binning_rows = rows.data() + row;
+				row += per_binning;
+				futures.push_back( pool.Submit( [&, binning_type, bins_count, dims, binning_rows]
+				{
+					Stopwatch stopwatch;
+					SweepBinning binning;
+					binning.mBins = CalculateBins( training_sim, training_exp, dims, grid.mDimShift, binning_type, bins_count );
+					binning.mStats = CalculateBinningStats( binning.mBins, training_sim, training_exp, grid.mDimShift );
+					std::tie( binning.mSimTestHist, binning.mExpTestHist ) = CalculateHistograms( binning.mBins,
+																								  testing_sim,
+																								  testing_exp,
+																								  grid.mDimShift );
+					binning.mMs = stopwatch.Ms();
+
+					std::vector<std::future<void>> decompositions;
+					for( size_t n = 0; n < grid.mNeighborsMatTypes.size(); n++ )
+					{
+						auto* type_rows = binning_rows + n * alphas;
+						auto type = grid.mNeighborsMatTypes[n];
+						for( size_t k = 0; k < alphas; k++ )
+						{
+							type_rows[k].mBinningType = binning_type;
+							type_rows[k].mBinsCount = bins_count;
+							type_rows[k].mDims = dims;
+							type_rows[k].mNeighborsMatType = type;
+						}
+						decompositions.push_back( pool.Submit( [&, type, type_rows] { SolveAlphas( grid, binning, type, type_rows ); } ) );
+					}
+					WaitAll( pool, decompositions );
+				} ) );
+			}
+
+	WaitAll( pool, futures );
+	return rows;
+}
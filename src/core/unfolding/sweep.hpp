@@ -0,0 +1,53 @@
+#pragma once
+
+#include "bin.hpp"
+#include "binning_pipeline.hpp"
+#include "system_solver.hpp"
+
+#include <vector>
+
+// Alpha of a sweep row, selections other than Manual take it from the alpha scan
+struct SweepAlpha
+{
+	AlphaSelection mSelection = AlphaSelection::Manual;
+	double mValue = 0;
+};
+
+struct SweepGrid
+{
+	std::vector<BinningType> mBinningTypes;
+	std::vector<Int> mBinsCounts;
+	std::vector<size_t> mDims;
+	std::vector<NeighborsMatType> mNeighborsMatTypes;
+	std::vector<SweepAlpha> mAlphas;
+	size_t mDimShift = 0;
+};
+
+struct SweepRow
+{
+	BinningType mBinningType = BinningType::Static;
+	Int mBinsCount = 0;
+	size_t mDims = 0;
+	NeighborsMatType mNeighborsMatType = NeighborsMatType::Binary;
+	SweepAlpha mAlphaRequest;
+	// Alpha the solution was found with, NaN if the selection needs a scan the solver can't do
+	double mAlpha = 0;
+	size_t mBins = 0;
+	// Against the testing exp histogram
+	Float mMse = 0;
+	// Stage timings, a shared stage is reported in every row using it
+	double mBinningMs = 0;
+	double mDecompositionMs = 0;
+	double mSolveMs = 0;
+};
+
+// Unfolds every combination of the grid with the Tikhonov solver, training and testing
+// events as in the CLI. Binning is done once per ( binning type, bins count, dims ) and
+// the decomposition once per neighbors type on top of it, alphas only solve.
+// Binnings and decompositions are tasks of the global pool, the tasks waiting for their
+// subtasks run queued ones, so the cores stay busy. Rows are in the grid order
+std::vector<SweepRow> RunSweep( const EventsView& training_sim,
+								const EventsView& training_exp,
+								const EventsView& testing_sim,
+								const EventsView& testing_exp,
+								const SweepGrid& grid );
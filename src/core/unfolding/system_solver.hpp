@@ -3,23 +3,39 @@
 #include "static_vector.hpp"
 #include "bin.hpp"
 #include "migration_mat.hpp"
+#include "binning_pipeline.hpp"
+#include "thread_pool.hpp"
+#include "sparse_mat.hpp"
+#include "solvers.h"
+#include <limits>
 #include <sstream>
 
 
-inline dfVec CalculateHistogram( Bins& bins, std::span<sfVec> data, size_t dim_shift )
+inline dfVec CalculateHistogram( const Bins& bins, const EventsView& events, size_t dim_shift )
 {
-	dfVec hist;
-	hist.setlength( bins.mBins.size() );
-	for( int i = 0; i < hist.length(); i++ )
-		hist[i] = 0;
+	auto size = bins.Size();
+	auto data = events.ShiftDims( bins.Dims(), dim_shift );
+	auto chunks = ChunksCount( data.Size() );
+	std::vector<std::vector<Float>> chunk_hists( chunks, std::vector<Float>( size ) );
 
-	for( const auto& vec : data )
+	ParallelChunks( data.Size(), chunks, [&]( size_t begin, size_t end, size_t chunk )
 	{
-		if( !bins.HitBinRange( vec ) )
-			continue;
-		auto md_idx = bins.GetBinByValue( ShiftDimTransform( vec, bins.Dims(), dim_shift ) ).mIdx;
-		auto idx = FromMultidimentionalIdx( md_idx, bins.mSize );
-		hist[idx]++;
+		auto& chunk_hist = chunk_hists[chunk];
+		std::vector<int> idxs( end - begin );
+		bins.GetBinIdxs( data, begin, end, idxs.data() );
+		for( auto idx : idxs )
+			if( idx != -1 )
+				chunk_hist[idx]++;
+	} );
+
+	// Counts are integers, so reduction order doesn't change the result
+	dfVec hist;
+	hist.setlength( size );
+	for( size_t i = 0; i < size; i++ )
+	{
+		hist[i] = 0;
+		for( const auto& chunk_hist : chunk_hists )
+			hist[i] += chunk_hist[i];
 	}
 	return hist;
 }
@@ -45,51 +61,44 @@ enum class NeighborsMatType
 	NonbinaryMassCenters
 };
 
-inline bool IsNaigbors( const Bin& first, const Bin& second )
-{
-	size_t sum = 0;
-	for( size_t i = 0; i < first.mIdx.size(); i++ )
-		sum += abs( first.mIdx[i] - second.mIdx[i] );
-	return sum == 1;
-}
-
-inline dfMat CalculateBinaryNeighborsMat( const Bins& bins )
+// Neighbors are found from the grid strides, a bin has 2 * dims of them at most
+inline CsrMat CalculateBinaryNeighborsCsr( const Bins& bins )
 {
-	auto size = bins.OneDimSize();
-	auto mat = CreateSqrMat( size );
+	auto size = bins.Size();
+	CsrMat mat( size );
+	std::vector<size_t> neighbors;
 	for( size_t i = 0; i < size; i++ )
 	{
-		int sum = 0;
-		for( size_t j = 0; j < size; j++ )
+		neighbors.clear();
+		for( size_t dim = 0; dim < bins.Dims(); dim++ )
 		{
-			int value = IsNaigbors( bins[i], bins[j] );
-			mat[i][j] = -value;
-			sum += value;
+			auto idx = bins.DimIdx( i, dim );
+			auto stride = (size_t)bins.mStrides[dim];
+			if( idx > 0 )
+				neighbors.push_back( i - stride );
+			if( idx + 1 < bins.mSize[dim] )
+				neighbors.push_back( i + stride );
 		}
-		mat[i][i] = sum;
+		neighbors.push_back( i );
+		std::ranges::sort( neighbors );
+
+		for( auto j : neighbors )
+			mat.Add( j, j == i ? (Float)neighbors.size() - 1 : -1 );
+		mat.EndRow();
 	}
 	return mat;
 }
 
-inline Float NeighborsStatProximity( const Bin& first, const Bin& second )
+inline dfMat CalculateBinaryNeighborsMat( const Bins& bins )
 {
-	Float proximity = 0;
-	for( const auto& pair : first )
-		proximity += second.ValueInBin( pair.second );
-	return proximity;
+	return CalculateBinaryNeighborsCsr( bins ).ToDense();
 }
 
-inline Float NeighborsMassCenterProximity( const Bin& first, const Bin& second )
+inline Float NeighborsMassCenterProximity( const BinningStats& stats, size_t first, size_t second )
 {
-	sfVec f_mean( first.Dims() );
-	sfVec s_mean( second.Dims() );
-	for( const auto& pair : first )
-		f_mean = f_mean + pair.first;
-	f_mean = f_mean / ( (int)first.Size() + 1 );
-	for( const auto& pair : second )
-		s_mean = s_mean + pair.first;
-	s_mean = s_mean / ( (int)second.Size() + 1 );
-	
+	auto f_mean = stats.MassCenter( first );
+	auto s_mean = stats.MassCenter( second );
+
 	Float proximity = 0;
 	for( size_t i = 0; i < f_mean.size(); i++ )
 		proximity += std::pow( f_mean[i] - s_mean[i], 2 );
@@ -98,40 +107,71 @@ inline Float NeighborsMassCenterProximity( const Bin& first, const Bin& second )
 	return 1.0 / proximity;
 }
 
-inline dfMat CalculateNotBinaryNeighborsMat( const Bins& bins, NeighborsMatType type )
+// Row i holds -proximity( i, j ) and their sum on the diagonal, normalized by the sum
+inline void AddNeighborsRow( CsrMat& mat, size_t row, const std::vector<std::pair<size_t, Float>>& proximities )
 {
-	auto size = bins.OneDimSize();
-	auto mat = CreateSqrMat( size );
-	for( size_t i = 0; i < size; i++ )
+	Float sum = 0;
+	for( auto [col, value] : proximities )
+		sum += value;
+	auto norm = sum ? sum : 1;
+
+	bool diagonal = false;
+	for( auto [col, value] : proximities )
 	{
-		Float sum = 0; 
-		for( size_t j = 0; j < size; j++ )
+		if( !diagonal && col > row )
 		{
-			if( i == j )
-				continue;
+			mat.Add( row, sum / norm );
+			diagonal = true;
+		}
+		mat.Add( col, -value / norm );
+	}
+	if( !diagonal )
+		mat.Add( row, sum / norm );
+	mat.EndRow();
+}
 
-			Float value = 0;
-			switch( type )
-			{
-			case NeighborsMatType::NonbinaryStatistic:
-				value = NeighborsStatProximity( bins[i], bins[j] );
-				break;
-			case NeighborsMatType::NonbinaryMassCenters:
-				value = NeighborsMassCenterProximity( bins[i], bins[j] );
-				break;
-			}
-			mat[i][j] = -value;
-			sum += value;
+// Statistic proximity of bins i and j is the training events of i measured in j, so a row
+// only has the migrations of its exp bin. Mass centers proximity is never zero, that C is dense
+inline CsrMat CalculateNotBinaryNeighborsCsr( const BinningStats& stats, NeighborsMatType type )
+{
+	auto size = stats.mSize;
+	CsrMat mat( size );
+	std::vector<std::pair<size_t, Float>> proximities;
+	if( type == NeighborsMatType::NonbinaryStatistic )
+	{
+		// Migrations by exp bin, sim bins stay sorted
+		auto migrations = stats.mMigrations;
+		std::ranges::stable_sort( migrations, {}, &Migration::mExpBin );
+		auto migration = migrations.begin();
+		for( size_t i = 0; i < size; i++ )
+		{
+			proximities.clear();
+			for( ; migration != migrations.end() && migration->mExpBin == i; migration++ )
+				if( migration->mSimBin != i && migration->mCount )
+					proximities.emplace_back( migration->mSimBin, migration->mCount );
+			AddNeighborsRow( mat, i, proximities );
 		}
-		mat[i][i] = sum;
+		return mat;
+	}
+
+	for( size_t i = 0; i < size; i++ )
+	{
+		proximities.clear();
 		for( size_t j = 0; j < size; j++ )
-			mat[i][j] /= ( sum ? sum : 1 );
+			if( i != j )
+				proximities.emplace_back( j, NeighborsMassCenterProximity( stats, i, j ) );
+		AddNeighborsRow( mat, i, proximities );
 	}
 	return mat;
 }
 
+inline dfMat CalculateNotBinaryNeighborsMat( const BinningStats& stats, NeighborsMatType type )
+{
+	return CalculateNotBinaryNeighborsCsr( stats, type ).ToDense();
+}
+
 // C or K mat
-inline dfMat CalculateNeighborsMat( const Bins& bins, NeighborsMatType type )
+inline dfMat CalculateNeighborsMat( const Bins& bins, const BinningStats& stats, NeighborsMatType type )
 {
 	switch( type )
 	{
@@ -139,7 +179,7 @@ inline dfMat CalculateNeighborsMat( const Bins& bins, NeighborsMatType type )
 		return CalculateBinaryNeighborsMat( bins );
 	case NeighborsMatType::NonbinaryStatistic:
 	case NeighborsMatType::NonbinaryMassCenters:
-		return CalculateNotBinaryNeighborsMat( bins, type );
+		return CalculateNotBinaryNeighborsMat( stats, type );
 	}
 	throw std::runtime_error( "Invaid Meighbors type" );
 }
@@ -151,6 +191,19 @@ inline dfMat FluctuateMat( dfMat mat )
 	return mat;
 }
 
+inline CsrMat FluctuateMat( CsrMat mat )
+{
+	mat.AddToDiagonal( 0.001 );
+	return mat;
+}
+
+inline CsrMat CalculateNeighborsCsr( const Bins& bins, const BinningStats& stats, NeighborsMatType type )
+{
+	if( type == NeighborsMatType::Binary )
+		return CalculateBinaryNeighborsCsr( bins );
+	return CalculateNotBinaryNeighborsCsr( stats, type );
+}
+
 inline dfMat ExtendSystemMat( const dfMat& mat, Float alpha )
 {
 	dfMat res;
@@ -189,10 +242,21 @@ inline std::tuple<dfMat, dfVec, dfMat> SVD( const dfMat A )
 	return { U, s, Vt };
 }
 
+// Singular values only, U and Vt are not requested
+inline dfVec SingularValues( const dfMat& A )
+{
+	dfMat U;
+	dfVec s;
+	dfMat Vt;
+	alglib::rmatrixsvd( A, A.rows(), A.cols(), 0, 0, 2, s, U, Vt );
+	return s;
+}
+
+// C is neighbors mat, Ci is inverse of fluctuated C
 inline dfVec SolveSystem( const dfMat& A,
-						  const Bins& bins,
+						  const dfMat& C,
+						  const dfMat& Ci,
 						  dfVec m,
-						  NeighborsMatType nighbors_type,
 						  double alpha,
 						  bool debug )
 {
@@ -202,10 +266,8 @@ inline dfVec SolveSystem( const dfMat& A,
 	out << "m\n" << m << "\n\n";
 	out << "A\n" << A << "\n\n";
 
-	auto C = CalculateNeighborsMat( bins, nighbors_type );
 	auto Cf = FluctuateMat( C );
 	out << "C\n" << C << "\n\n";
-	auto Ci = MatInverse( Cf );
 
 	auto AxCi = MatMul( A, Ci );
 	out << "AxCi\n" << AxCi << "\n\n";
@@ -250,4 +312,401 @@ inline dfVec SolveSystem( const dfMat& A,
 		std::cout << out.str() << std::endl;
 
 	return tau;
-}
\ No newline at end of file
+}
+
+inline dfVec SolveSystem( const dfMat& A,
+						  const Bins& bins,
+						  const BinningStats& stats,
+						  dfVec m,
+						  NeighborsMatType nighbors_type,
+						  double alpha,
+						  bool debug )
+{
+	auto C = CalculateNeighborsMat( bins, stats, nighbors_type );
+	auto Ci = MatInverse( FluctuateMat( C ) );
+	return SolveSystem( A, C, Ci, m, alpha, debug );
+}
+
+enum class DenseSolverType
+{
+	// TikhonovSolver, SolveSystem in standard form
+	Standard,
+	// SolveSystem
+	Legacy,
+	// SolveSystemCholesky, same solution as Legacy
+	Cholesky
+};
+
+// Closed form of SolveSystem without the doubled matrix, the inverse and U.
+// Its filtered SVD V s / ( s^2 + alpha ) Ut of [ A; sqrt( alpha ) Cf ] equals
+// ( At A + alpha ( Cft Cf + I ) )^-1 At m, solved here by Cholesky.
+// Cf is fluctuated C
+inline dfVec SolveSystemCholesky( const dfMat& A, const dfMat& Cf, const dfVec& m, double alpha )
+{
+	auto size = A.cols();
+	dfMat normal;
+	normal.setlength( size, size );
+	// Upper triangles of At A + alpha Cft Cf
+	alglib::rmatrixsyrk( size, A.rows(), 1, A, 0, 0, 2, 0, normal, 0, 0, true );
+	alglib::rmatrixsyrk( size, Cf.rows(), alpha, Cf, 0, 0, 2, 1, normal, 0, 0, true );
+	for( int i = 0; i < size; i++ )
+		normal[i][i] += alpha;
+
+	dfVec x;
+	x.setlength( size );
+	alglib::rmatrixmv( size, A.rows(), A, 0, 0, 1, m, 0, x, 0 );
+
+	if( !alglib::spdmatrixcholesky( normal, size, true ) )
+		throw std::runtime_error( "Normal equations matrix isn't positive definite, alpha is too small" );
+	alglib::ae_int_t info;
+	alglib::spdmatrixcholeskysolvefast( normal, size, true, x, info );
+	if( info <= 0 )
+		throw std::runtime_error( std::format( "Cholesky solve failed with info {}", info ) );
+	return x;
+}
+
+// Standard deviations from the covariance diagonal
+inline dfVec CovarianceErrors( const dfMat& cov )
+{
+	dfVec errors;
+	errors.setlength( cov.rows() );
+	for( int i = 0; i < cov.rows(); i++ )
+		errors[i] = std::sqrt( std::max<Float>( cov[i][i], 0 ) );
+	return errors;
+}
+
+// Alphas evaluated by TikhonovSolver::ScanAlpha
+constexpr size_t ALPHA_SCAN_SIZE = 256;
+
+enum class AlphaSelection
+{
+	Manual,
+	LCurve,
+	Gcv
+};
+
+// Residual and solution norms over log spaced alphas
+struct AlphaScan
+{
+	std::vector<Float> mAlphas;
+	// |A tau - m|
+	std::vector<Float> mResidualNorms;
+	// sqrt( |Cf tau|^2 + |tau|^2 )
+	std::vector<Float> mSolutionNorms;
+	std::vector<Float> mGcv;
+	// Max curvature of the log-log L-curve, see ScanAlpha
+	size_t mLCurveCorner = 0;
+	size_t mGcvMin = 0;
+
+	Float Alpha( AlphaSelection selection, Float manual ) const
+	{
+		switch( selection )
+		{
+		case AlphaSelection::Manual:
+			return manual;
+		case AlphaSelection::LCurve:
+			return mAlphas[mLCurveCorner];
+		case AlphaSelection::Gcv:
+			return mAlphas[mGcvMin];
+		}
+		throw std::runtime_error( "Invalid alpha selection" );
+	}
+};
+
+// Tikhonov solution of SolveSystem, min |A tau - m|^2 + alpha ( |Cf tau|^2 + |tau|^2 ), in standard form.
+// The penalty Cft Cf + I = Rt R is Cholesky factorized, with y = R tau the system is A Ri y = m,
+// its SVD is calculated once and every alpha only applies filter factors s^2 / ( s^2 + alpha ),
+// O(n^2) per solve
+class TikhonovSolver
+{
+	dfMat mUt;
+	dfVec mS;
+	// Ri V, maps the filtered coefficients straight to tau
+	dfMat mRiV;
+
+public:
+	TikhonovSolver() = default;
+
+	// Cf is fluctuated C
+	TikhonovSolver( const dfMat& A, const dfMat& Cf, bool debug = false )
+	{
+		auto size = Cf.cols();
+		dfMat R;
+		R.setlength( size, size );
+		// Upper triangle of Cft Cf + I
+		alglib::rmatrixsyrk( size, Cf.rows(), 1, Cf, 0, 0, 2, 0, R, 0, 0, true );
+		for( int i = 0; i < size; i++ )
+			R[i][i] += 1;
+		if( !alglib::spdmatrixcholesky( R, size, true ) )
+			throw std::runtime_error( "Penalty matrix isn't positive definite" );
+
+		// A Ri and Ri V by triangular solves, R isn't inverted
+		auto ARi = A;
+		alglib::rmatrixrighttrsm( A.rows(), size, R, 0, 0, true, false, 0, ARi, 0, 0 );
+		auto [U, s, Vt] = SVD( ARi );
+		mUt = MatTranpose( U );
+		mS = s;
+		mRiV = MatTranpose( Vt );
+		alglib::rmatrixlefttrsm( size, mRiV.cols(), R, 0, 0, true, false, 0, mRiV, 0, 0 );
+
+		if( debug )
+			std::cout << "ARi\n" << ARi << "\n\ns\n" << mS << "\n\n";
+	}
+
+	dfVec Solve( const dfVec& m, double alpha, bool debug = false ) const
+	{
+		auto d = MatVecMul( mUt, m );
+
+		dfVec z;
+		z.setlength( mS.length() );
+		for( int i = 0; i < mS.length(); i++ )
+			z[i] = d[i] * mS[i] / ( std::pow( mS[i], 2 ) + alpha );
+
+		auto tau = MatVecMul( mRiV, z );
+		if( debug )
+			std::cout << "alpha\n" << alpha << "\n\nz\n" << z << "\n\ntau\n" << tau << "\n\n";
+		return tau;
+	}
+
+	// Covariance of Solve( m, alpha ) from Poisson errors of m. tau = Ri V F Ut m is linear in m
+	// with filter factors F = s / ( s^2 + alpha ), so cov = T diag( m ) Tt with T = Ri V F Ut,
+	// two products of the cached matrices and no decomposition
+	dfMat Covariance( const dfVec& m, double alpha ) const
+	{
+		auto factor = MatMul( mRiV, FilteredUt( m, alpha ) );
+
+		dfMat cov;
+		cov.setlength( factor.rows(), factor.rows() );
+		alglib::rmatrixsyrk( factor.rows(), factor.cols(), 1, factor, 0, 0, 0, 0, cov, 0, 0, true );
+		for( int i = 0; i < cov.rows(); i++ )
+			for( int j = 0; j < i; j++ )
+				cov[i][j] = cov[j][i];
+		return cov;
+	}
+
+	// Standard deviations of the solution bins [begin, end), the Covariance diagonal from
+	// the rows of T diag( sqrt( m ) ) only. Still O(n^3) for all bins, so callers can split it
+	dfVec CovarianceErrors( const dfVec& m, double alpha, int begin, int end ) const
+	{
+		auto filtered = FilteredUt( m, alpha );
+		dfMat factor;
+		factor.setlength( end - begin, filtered.cols() );
+		alglib::rmatrixgemm( end - begin, filtered.cols(), mRiV.cols(), 1, mRiV, begin, 0, 0, filtered, 0, 0, 0, 0, factor, 0, 0 );
+
+		dfVec errors;
+		errors.setlength( end - begin );
+		for( int i = 0; i < factor.rows(); i++ )
+		{
+			Float sum = 0;
+			for( int j = 0; j < factor.cols(); j++ )
+				sum += factor[i][j] * factor[i][j];
+			errors[i] = std::sqrt( sum );
+		}
+		return errors;
+	}
+
+	// Singular values of A Ri
+	const dfVec& SingularValues() const
+	{
+		return mS;
+	}
+
+	// Every alpha costs one pass over the singular values, the residual and the penalty
+	// norm are norms of the filtered coefficients since |R tau| = |y| in standard form
+	AlphaScan ScanAlpha( const dfVec& m, size_t count = ALPHA_SCAN_SIZE ) const
+	{
+		auto size = (size_t)mS.length();
+		if( size == 0 || count < 3 )
+			throw std::runtime_error( "Alpha scan needs a non empty system and 3 alphas at least" );
+
+		auto d = MatVecMul( mUt, m );
+		std::vector<Float> s2( size );
+		std::vector<Float> d2( size );
+		Float m2 = 0;
+		Float d2_sum = 0;
+		for( size_t i = 0; i < size; i++ )
+		{
+			s2[i] = mS[i] * mS[i];
+			d2[i] = d[i] * d[i];
+			d2_sum += d2[i];
+		}
+		for( int i = 0; i < m.length(); i++ )
+			m2 += m[i] * m[i];
+		// Part of m out of the range of A Ri, zero for regular square systems
+		auto outside = std::max<Float>( m2 - d2_sum, 0 );
+
+		// From the smallest to the largest squared singular value. Numerically zero ones
+		// come from empty bins, below them the L-curve only has a tiny corner at its end
+		auto rank_tolerance = mS[0] * (Float)size * std::numeric_limits<Float>::epsilon();
+		Float max_alpha = s2.front();
+		Float min_alpha = max_alpha * 1e-12;
+		for( size_t i = size; i-- > 0; )
+			if( mS[i] > rank_tolerance )
+			{
+				min_alpha = std::max( s2[i], min_alpha );
+				break;
+			}
+		AlphaScan scan;
+		for( size_t k = 0; k < count; k++ )
+		{
+			Float alpha = min_alpha * std::pow( max_alpha / min_alpha, (Float)k / (Float)( count - 1 ) );
+			Float residual = outside;
+			Float solution = 0;
+			Float filters = 0;
+			for( size_t i = 0; i < size; i++ )
+			{
+				Float f = s2[i] / ( s2[i] + alpha );
+				residual += ( 1 - f ) * ( 1 - f ) * d2[i];
+				// ( f d / s )^2 without division by zero singular values
+				solution += f * d2[i] / ( s2[i] + alpha );
+				filters += f;
+			}
+			Float dof = (Float)m.length() - filters;
+			scan.mAlphas.push_back( alpha );
+			scan.mResidualNorms.push_back( std::sqrt( residual ) );
+			scan.mSolutionNorms.push_back( std::sqrt( solution ) );
+			scan.mGcv.push_back( dof > 0 ? residual / ( dof * dof ) : std::numeric_limits<Float>::infinity() );
+		}
+
+		// Curvature of ( log residual, log solution ) by central differences over log alpha.
+		// Above the second singular value only the dominant component is left, its knee
+		// is the sharpest one but over-smooths, so the corner is searched below it
+		Float max_corner_alpha = size > 1 ? s2[1] : max_alpha;
+		std::vector<Float> curvatures( count, -std::numeric_limits<Float>::infinity() );
+		size_t last = 1;
+		for( size_t k = 1; k + 1 < count && scan.mAlphas[k] <= max_corner_alpha; k++ )
+		{
+			auto x = [&]( size_t i ) { return std::log( scan.mResidualNorms[i] ); };
+			auto y = [&]( size_t i ) { return std::log( scan.mSolutionNorms[i] ); };
+			Float dx = ( x( k + 1 ) - x( k - 1 ) ) / 2;
+			Float dy = ( y( k + 1 ) - y( k - 1 ) ) / 2;
+			Float ddx = x( k + 1 ) - 2 * x( k ) + x( k - 1 );
+			Float ddy = y( k + 1 ) - 2 * y( k ) + y( k - 1 );
+			Float norm = std::pow( dx * dx + dy * dy, 1.5 );
+			if( norm != 0 )
+				curvatures[k] = ( dx * ddy - ddx * dy ) / norm;
+			last = k;
+		}
+
+		// Bends are runs of positive curvature. A run reaching an end of the searched range goes
+		// on past it, at the smallest alpha it is the residual meeting its floor from nearly
+		// empty bins. The corner is the sharpest point of the runs inside the range
+		Float max_curvature = -std::numeric_limits<Float>::infinity();
+		scan.mLCurveCorner = 0;
+		for( size_t begin = 1; begin <= last; )
+		{
+			auto end = begin;
+			while( end <= last && curvatures[end] > 0 )
+				end++;
+			if( begin > 1 && end <= last )
+				for( size_t k = begin; k < end; k++ )
+					if( curvatures[k] > max_curvature )
+					{
+						max_curvature = curvatures[k];
+						scan.mLCurveCorner = k;
+					}
+			begin = end + 1;
+		}
+		// Without such a run the sharpest point of the range is taken
+		if( !scan.mLCurveCorner )
+			scan.mLCurveCorner = std::ranges::max_element( curvatures.begin() + 1, curvatures.begin() + last + 1 ) - curvatures.begin();
+		scan.mGcvMin = std::ranges::min_element( scan.mGcv ) - scan.mGcv.begin();
+		return scan;
+	}
+
+private:
+	// F Ut diag( sqrt( m ) ), T diag( sqrt( m ) ) without the Ri V product
+	dfMat FilteredUt( const dfVec& m, double alpha ) const
+	{
+		auto size = mS.length();
+		dfMat filtered;
+		filtered.setlength( size, m.length() );
+		for( int i = 0; i < size; i++ )
+		{
+			auto filter = mS[i] / ( std::pow( mS[i], 2 ) + alpha );
+			for( int j = 0; j < m.length(); j++ )
+				filtered[i][j] = filter * mUt[i][j] * std::sqrt( std::max<Float>( m[j], 0 ) );
+		}
+		return filtered;
+	}
+};
+
+// Bins count from which the sparse solver is used, dense SVD and inverse take O(n^3)
+constexpr size_t SPARSE_SOLVER_MIN_BINS = 1000;
+constexpr size_t CGLS_MAX_ITERATIONS = 20000;
+constexpr Float CGLS_TOLERANCE = 1e-10;
+
+// Same problem as TikhonovSolver without inverting or decomposing anything:
+// CGLS over [ A; sqrt( alpha ) Cf; sqrt( alpha ) I ] tau = [ m; 0; 0 ], an iteration costs O( nonzeros ).
+// Cf is fluctuated C
+inline dfVec SolveSparseSystem( const CsrMat& A, const CsrMat& Cf, const dfVec& m, double alpha, bool debug )
+{
+	auto size = A.Cols();
+	auto sqrt_alpha = std::sqrt( alpha );
+	auto dot = []( const dfVec& f, const dfVec& s )
+	{
+		Float res = 0;
+		for( int i = 0; i < f.length(); i++ )
+			res += f[i] * s[i];
+		return res;
+	};
+	// s = At r1 + sqrt( alpha ) ( Cft r2 + r3 )
+	auto mul_transposed = [&]( const dfVec& r1, const dfVec& r2, const dfVec& r3 )
+	{
+		auto res = A.MulTransposed( r1 );
+		auto reg = Cf.MulTransposed( r2 );
+		for( size_t i = 0; i < size; i++ )
+			res[i] += sqrt_alpha * ( reg[i] + r3[i] );
+		return res;
+	};
+
+	dfVec tau;
+	tau.setlength( size );
+	for( size_t i = 0; i < size; i++ )
+		tau[i] = 0;
+	dfVec r1 = m;
+	dfVec r2;
+	r2.setlength( Cf.Rows() );
+	for( size_t i = 0; i < Cf.Rows(); i++ )
+		r2[i] = 0;
+	dfVec r3 = tau;
+
+	auto s = mul_transposed( r1, r2, r3 );
+	auto p = s;
+	auto gamma = dot( s, s );
+	auto stop = CGLS_TOLERANCE * CGLS_TOLERANCE * gamma;
+	size_t iteration = 0;
+	for( ; iteration < CGLS_MAX_ITERATIONS && gamma > stop; iteration++ )
+	{
+		auto q1 = A.Mul( p );
+		auto q2 = Cf.Mul( p );
+		for( int i = 0; i < q2.length(); i++ )
+			q2[i] *= sqrt_alpha;
+		// Identity block of p is sqrt( alpha ) p
+		auto delta = dot( q1, q1 ) + dot( q2, q2 ) + alpha * dot( p, p );
+		if( delta == 0 )
+			break;
+
+		auto step = gamma / delta;
+		for( size_t i = 0; i < size; i++ )
+			tau[i] += step * p[i];
+		for( int i = 0; i < r1.length(); i++ )
+			r1[i] -= step * q1[i];
+		for( int i = 0; i < r2.length(); i++ )
+			r2[i] -= step * q2[i];
+		for( size_t i = 0; i < size; i++ )
+			r3[i] -= step * sqrt_alpha * p[i];
+
+		s = mul_transposed( r1, r2, r3 );
+		auto next_gamma = dot( s, s );
+		auto beta = next_gamma / gamma;
+		gamma = next_gamma;
+		for( size_t i = 0; i < size; i++ )
+			p[i] = s[i] + beta * p[i];
+	}
+
+	if( debug )
+		std::cout << std::format( "CGLS iterations {} gradient norm {}\n", iteration, std::sqrt( gamma ) )
+				  << "tau\n" << tau << "\n\n";
+	return tau;
+}
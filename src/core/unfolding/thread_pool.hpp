@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Minimal events amount worth a separate task
+constexpr size_t MIN_CHUNK_SIZE = 1 << 14;
+
+class ThreadPool
+{
+	std::vector<std::thread> mWorkers;
+	std::queue<std::function<void()>> mTasks;
+	std::mutex mMutex;
+	std::condition_variable mCondition;
+	bool mStop = false;
+
+public:
+	explicit ThreadPool( size_t threads = std::max( 1u, std::thread::hardware_concurrency() ) )
+	{
+		for( size_t i = 0; i < threads; i++ )
+			mWorkers.emplace_back( [this]
+			{
+				while( true )
+				{
+					std::function<void()> task;
+					{
+						std::unique_lock lock( mMutex );
+						mCondition.wait( lock, [this] { return mStop || !mTasks.empty(); } );
+						if( mStop && mTasks.empty() )
+							return;
+						task = std::move( mTasks.front() );
+						mTasks.pop();
+					}
+					task();
+				}
+			} );
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard lock( mMutex );
+			mStop = true;
+		}
+		mCondition.notify_all();
+		for( auto& worker : mWorkers )
+			worker.join();
+	}
+
+	ThreadPool( const ThreadPool& ) = delete;
+	ThreadPool& operator=( const ThreadPool& ) = delete;
+
+	size_t Size() const
+	{
+		return mWorkers.size();
+	}
+
+	template <typename F>
+	auto Submit( F&& func ) -> std::future<std::invoke_result_t<F>>
+	{
+		using Result = std::invoke_result_t<F>;
+		auto task = std::make_shared<std::packaged_task<Result()>>( std::forward<F>( func ) );
+		auto future = task->get_future();
+		{
+			std::lock_guard lock( mMutex );
+			mTasks.emplace( [task] { ( *task )(); } );
+		}
+		mCondition.notify_one();
+		return future;
+	}
+
+	// Runs queued tasks while waiting, so tasks waiting on subtasks can't deadlock the pool
+	template <typename T>
+	T Wait( std::future<T>& future )
+	{
+		while( future.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready )
+		{
+			std::function<void()> task;
+			{
+				std::lock_guard lock( mMutex );
+				if( mTasks.empty() )
+					break;
+				task = std::move( mTasks.front() );
+				mTasks.pop();
+			}
+			task();
+		}
+		return future.get();
+	}
+
+	static ThreadPool& Global()
+	{
+		static ThreadPool pool;
+		return pool;
+	}
+};
+
+inline size_t ChunksCount( size_t size, size_t min_chunk_size = MIN_CHUNK_SIZE )
+{
+	return std::clamp<size_t>( size / min_chunk_size, 1, ThreadPool::Global().Size() );
+}
+
+// Calls func( begin, end, chunk ) for contiguous chunks of [0, size),
+// the calling thread takes the first chunk. Nothing is called for an empty range
+template <typename F>
+void ParallelChunks( size_t size, size_t chunks, F&& func )
+{
+	if( size == 0 )
+		return;
+	auto& pool = ThreadPool::Global();
+	auto chunk_begin = [&]( size_t chunk ) { return size * chunk / chunks; };
+
+	std::vector<std::future<void>> futures;
+	for( size_t chunk = 1; chunk < chunks; chunk++ )
+		futures.push_back( pool.Submit( [&, chunk] { func( chunk_begin( chunk ), chunk_begin( chunk + 1 ), chunk ); } ) );
+
+	std::exception_ptr error;
+	try
+	{
+		func( chunk_begin( 0 ), chunk_begin( 1 ), size_t( 0 ) );
+	}
+	catch( ... )
+	{
+		error = std::current_exception();
+	}
+	for( auto& future : futures )
+	{
+		try
+		{
+			pool.Wait( future );
+		}
+		catch( ... )
+		{
+			if( !error )
+				error = std::current_exception();
+		}
+	}
+	if( error )
+		std::rethrow_exception( error );
+}
@@ -3,13 +3,20 @@
 #include "utils.hpp"
 #include "bin.hpp"
 #include "migration_mat.hpp"
+#include "binning_pipeline.hpp"
 #include "system_solver.hpp"
 #include "imgui.h"
 #include "ImGuiFileDialog.h"
+#include <algorithm>
 #include <format>
 #include <filesystem>
 #include <random>
 
+// Keeps precomputed data histograms small for huge samples
+constexpr size_t MAX_DATA_HISTOGRAM_BINS = 1000;
+// Solution bins per checkpoint of the errors stage
+constexpr int SOLUTION_ERRORS_BLOCK = 64;
+
 
 inline std::vector<Float> GetMatRawData( const dfMat& m )
 {
@@ -20,72 +27,241 @@ inline std::vector<Float> GetMatRawData( const dfMat& m )
 	return raw;
 }
 
-void UnfoldingApp::UpdateUIData()
+// Same bins as ImPlotBin_Scott, counted once instead of every frame
+std::pair<UnfoldingApp::DataHistogram, UnfoldingApp::DataHistogram> UnfoldingApp::CalculateDataHistograms( size_t col ) const
 {
-	mUIData.mProjections1D = Caclucate1DBinningProjections( mBins );
-	mUIData.mProjections2D = Caclucate2DBinningProjections( mBins );
-	mUIData.mMigrationRaw = GetMatRawData( mMigrationMat );
-	mUIData.mSimTestHist = CalculateHistogram( mBins, mTestingSim, mUIData.mDimShift );
-	mUIData.mExpTestHist = CalculateHistogram( mBins, mTestingExp, mUIData.mDimShift );
-	mUIData.mSolution = SolveSystem( mMigrationMat, 
-									 mBins,
-									 mUIData.mSimTestHist,
-									 mUIData.mNeighborsMatType,
-									 mUIData.mAlpha + mUIData.mAlphaLow / 1000000,
-									 mUIData.mDebugOuput );
+	auto calculate = [&]( size_t id )
+	{
+		const auto& column = mInputData.mCols[id];
+		auto values = column.Values();
+		DataHistogram hist;
+		hist.mName = std::format( "{} dim:{}", column.mName, col / 2 );
+		if( values.empty() )
+			return hist;
+
+		auto [min, max] = std::ranges::minmax( values );
+		Float mean = 0;
+		for( auto value : values )
+			mean += value;
+		mean /= (Float)values.size();
+		Float variance = 0;
+		for( auto value : values )
+			variance += ( value - mean ) * ( value - mean );
+		variance /= (Float)values.size();
+
+		Float width = 3.49 * std::sqrt( variance ) / std::cbrt( (Float)values.size() );
+		size_t bins = 1;
+		if( width > 0 )
+			bins = std::clamp<size_t>( (size_t)std::ceil( ( max - min ) / width ), 1, MAX_DATA_HISTOGRAM_BINS );
+		hist.mWidth = max > min ? ( max - min ) / (Float)bins : 1;
+
+		hist.mYs.resize( bins );
+		for( auto value : values )
+			hist.mYs[std::min( (size_t)( ( value - min ) / hist.mWidth ), bins - 1 )]++;
+		for( size_t i = 0; i < bins; i++ )
+			hist.mXs.push_back( min + hist.mWidth * ( (Float)i + 0.5 ) );
+		return hist;
+	};
+
+	const auto& cols = mInputData.mCols;
+	return { calculate( col % cols.size() ), calculate( ( col + 1 ) % cols.size() ) };
 }
 
-void UnfoldingApp::LoadData( const std::string& filename )
+// Runs on the worker thread. Rebinning is skipped when only solver parameters changed
+void UnfoldingApp::Compute( const ComputeRequest& request, const JobContext& context )
+{
+	auto& state = mComputeState;
+	if( !state.mBinningRequest || state.mBinningRequest->BinningKey() != request.BinningKey() )
+	{
+		// free space
+		state.mBinningRequest.reset();
+		state.mBins = Bins();
+		state.mBinningStats = BinningStats();
+		state.mLinAlgCache.Invalidate();
+
+		// calculate
+		state.mBins = CalculateBins( mTrainingSim,
+									 mTrainingExp,
+									 request.mDims,
+									 request.mDimShift,
+									 request.mBinningType,
+									 request.mBinsNum );
+		context.Check( 0.3f );
+		state.mBinningStats = CalculateBinningStats( state.mBins, mTrainingSim, mTrainingExp, request.mDimShift );
+		context.Check( 0.5f );
+		std::tie( state.mSimTestHist, state.mExpTestHist ) = CalculateHistograms( state.mBins,
+																				  mTestingSim,
+																				  mTestingExp,
+																				  request.mDimShift );
+		state.mDataHistograms.clear();
+		for( int col = request.mDimShift * 2; col < ( request.mDims + request.mDimShift ) * 2; col += 2 )
+			state.mDataHistograms.push_back( CalculateDataHistograms( col ) );
+		state.mBinningRequest = request;
+	}
+	context.Check( 0.6f );
+
+	auto result = std::make_unique<ComputeResult>();
+	result->mDims = state.mBins.Dims();
+	result->mDataHistograms = state.mDataHistograms;
+	result->mProjections1D = state.mBinningStats.mProjections1D;
+	result->mProjections2D = state.mBinningStats.mProjections2D;
+	result->mSimTestHist = state.mSimTestHist;
+	result->mExpTestHist = state.mExpTestHist;
+
+	// Dense matrices, SVD and alpha scan are skipped for big binnings
+	bool dense = state.mBins.Size() < SPARSE_SOLVER_MIN_BINS;
+	bool solution_errors = false;
+	result->mAlpha = request.mAlpha;
+	if( request.mUnfoldingMethod == UnfoldingMethod::Iterative )
+	{
+		const auto& migration_csr = state.mLinAlgCache.MigrationCsr( state.mBinningStats );
+		context.Check( 0.7f );
+		result->mSolution = SolveIterative( migration_csr,
+											state.mSimTestHist,
+											request.mIterations,
+											request.mTolerance,
+											request.mDebugOuput );
+	}
+	else if( !dense )
+	{
+		const auto& migration_csr = state.mLinAlgCache.MigrationCsr( state.mBinningStats );
+		const auto& neighbors_csr = state.mLinAlgCache.NeighborsCsr( state.mBins,
+																	 state.mBinningStats,
+																	 request.mNeighborsMatType );
+		context.Check( 0.7f );
+		result->mSolution = SolveSparseSystem( migration_csr,
+											   neighbors_csr,
+											   state.mSimTestHist,
+											   result->mAlpha,
+											   request.mDebugOuput );
+	}
+	else
+	{
+		const auto& solver = state.mLinAlgCache.Solver( state.mBins,
+														state.mBinningStats,
+														request.mNeighborsMatType,
+														request.mDebugOuput );
+		context.Check( 0.7f );
+		// Only this is left when alpha changes, errors are O(n^3) and calculated after the result is shown
+		result->mAlphaScan = solver.ScanAlpha( state.mSimTestHist );
+		result->mAlpha = result->mAlphaScan.Alpha( request.mAlphaSelection, request.mAlpha );
+		result->mSolution = solver.Solve( state.mSimTestHist, result->mAlpha, request.mDebugOuput );
+		if( state.mSolutionErrorsKey == std::tuple( state.mLinAlgCache.Version(), request.mNeighborsMatType, result->mAlpha ) )
+			result->mSolutionErrors = state.mSolutionErrors;
+		else
+			solution_errors = true;
+	}
+	context.Check( 0.8f );
+
+	if( dense )
+	{
+		const auto& migration_mat = state.mLinAlgCache.MigrationMat( state.mBinningStats );
+		result->mMigrationSize = (int)migration_mat.rows();
+		result->mMigrationRaw = GetMatRawData( migration_mat );
+		result->mSingularValues = state.mLinAlgCache.SingularValues( state.mBinningStats );
+	}
+	context.Check( 1.0f );
+
+	auto alpha = result->mAlpha;
+	{
+		std::lock_guard lock( mCompletedMutex );
+		mCompleted = std::move( result );
+		mCompletedErrors.reset();
+	}
+	if( solution_errors )
+		ComputeSolutionErrors( request, alpha, context );
+}
+
+// Second stage of a dense Tikhonov job, a newer request cancels it between blocks of bins,
+// so dragging the alpha slider doesn't wait for the errors of every alpha on the way
+void UnfoldingApp::ComputeSolutionErrors( const ComputeRequest& request, Float alpha, const JobContext& context )
+{
+	auto& state = mComputeState;
+	const auto& solver = state.mLinAlgCache.Solver( state.mBins, state.mBinningStats, request.mNeighborsMatType, request.mDebugOuput );
+	auto size = (int)state.mBins.Size();
+	dfVec errors;
+	errors.setlength( size );
+	for( int begin = 0; begin < size; begin += SOLUTION_ERRORS_BLOCK )
+	{
+		auto end = std::min( begin + SOLUTION_ERRORS_BLOCK, size );
+		auto block = solver.CovarianceErrors( state.mSimTestHist, alpha, begin, end );
+		for( int i = begin; i < end; i++ )
+			errors[i] = block[i - begin];
+		context.Check( 1.0f );
+	}
+	state.mSolutionErrors = errors;
+	state.mSolutionErrorsKey = std::tuple( state.mLinAlgCache.Version(), request.mNeighborsMatType, alpha );
+
+	std::lock_guard lock( mCompletedMutex );
+	mCompletedErrors = std::make_unique<dfVec>( std::move( errors ) );
+}
+
+void UnfoldingApp::PostCompute()
+{
+	ComputeRequest request{ mUIData.mBinsNum,
+							mUIData.mDims,
+							mUIData.mDimShift,
+							mUIData.mBinningType,
+							mUIData.mNeighborsMatType,
+							mUIData.mUnfoldingMethod,
+							(size_t)mUIData.mIterations,
+							mUIData.mEarlyStopping ? ITERATIVE_DEFAULT_TOLERANCE : 0,
+							mUIData.mAlpha + mUIData.mAlphaLow / 1000000,
+							mUIData.mAlphaSelection,
+							mUIData.mDebugOuput };
+	mWorker.Post( [this, request]( const JobContext& context )
+	{
+		Compute( request, context );
+	} );
+}
+
+// Jobs read the input data, so they are stopped before it's replaced
+void UnfoldingApp::ResetData()
 {
+	mWorker.Cancel();
+	mComputeState = ComputeState();
 	mInputData = InputData();
+}
+
+void UnfoldingApp::LoadData( const std::string& filename )
+{
+	ResetData();
 
 	mInputData = ::LoadData( { filename } );
-	mMaxDims = (int)mInputData.mCols.size() / 2;
+	mMaxDims = (int)mInputData.mSim.Dims();
 	mUIData.mDims = mMaxDims;
 	mUIData.mDimShift = 0;
 
-	size_t parts = 2;
-	auto splited_sim = SplitData( ToSpan( mInputData.mSim ), parts );
-	auto splited_exp = SplitData( ToSpan( mInputData.mExp ), parts );
-	mTrainingSim = splited_sim[0];
-	mTrainingExp = splited_exp[0];
-	mTestingSim = splited_sim[1];
-	mTestingExp = splited_exp[1];
+	SplitInputData();
 }
 
 void UnfoldingApp::LoadDataGaus( Float M, Float D )
 {
-	mInputData = InputData();
+	ResetData();
 
 	std::random_device rd{};
 	std::mt19937 gen{ rd() };
 	std::normal_distribution<> d{ M, D };
 	std::normal_distribution<> smear{ -3.5, 0.5 };
 
-	Column sim( "sim" );
-	Column exp( "exp" );
-	mInputData.mSim.mNames.push_back( "sim" );
-	mInputData.mExp.mNames.push_back( "exp" );
-
-	for( size_t i = 0; i < 1000000; i++ )
+	size_t size = 1000000;
+	Column sim{ "sim" };
+	Column exp{ "exp" };
+	sim.mData.reserve( size );
+	exp.mData.reserve( size );
+	for( size_t i = 0; i < size; i++ )
 	{
 		auto exp_value = d( gen );
 		auto sim_value = 0.5 * exp_value + smear( gen );
-		sim.mData.push_back( sim_value );
-		exp.mData.push_back( exp_value );
-		mInputData.mSim.mData.push_back( sfVec{ sim_value } );
-		mInputData.mExp.mData.push_back( sfVec{ exp_value } );
+		sim.mData.push_back( (Float)sim_value );
+		exp.mData.push_back( (Float)exp_value );
 	}
-	mInputData.mCols.push_back( std::move( sim ) );
-	mInputData.mCols.push_back( std::move( exp ) );
+	std::vector<Column> cols;
+	cols.push_back( std::move( sim ) );
+	cols.push_back( std::move( exp ) );
+	mInputData = CreateInputData( std::move( cols ) );
 
-	size_t parts = 2;
-	auto splited_sim = SplitData( ToSpan( mInputData.mSim ), parts );
-	auto splited_exp = SplitData( ToSpan( mInputData.mExp ), parts );
-	mTrainingSim = splited_sim[0];
-	mTrainingExp = splited_exp[0];
-	mTestingSim = splited_sim[1];
-	mTestingExp = splited_exp[1];
+	SplitInputData();
 
 	mMaxDims = 1;
 	mUIData.mDims = mMaxDims;
@@ -93,46 +269,27 @@ void UnfoldingApp::LoadDataGaus( Float M, Float D )
 }
 
 
-void UnfoldingApp::TestWithoutUI()
+void UnfoldingApp::SplitInputData()
 {
-	LoadData( "res/sim_p_6.txt" );
-	mMaxDims = (int)mInputData.mExp.Size();
-	mUIData.mBinningType = BinningType::Static;
-	mUIData.mBinsNum = 4;
-	mUIData.mDims = 1;
-	mUIData.mDimShift = 0;
-	
-	mBins = CalculateBins( mTrainingSim,
-						   mTrainingExp,
-						   mUIData.mDims,
-						   mUIData.mDimShift,
-						   mUIData.mBinningType,
-						   mUIData.mBinsNum );
-	mMigrationMat = CalculateMigrationMat( mBins );
-	auto m = CalculateHistogram( mBins, mTrainingSim, mUIData.mDimShift );
-	auto solution = SolveSystem( mMigrationMat, mBins, m, NeighborsMatType::NonbinaryStatistic, 0.1f, true );
+	size_t parts = 2;
+	auto splited_sim = SplitData( mInputData.mSim, parts );
+	auto splited_exp = SplitData( mInputData.mExp, parts );
+	mTrainingSim = splited_sim[0];
+	mTrainingExp = splited_exp[0];
+	mTestingSim = splited_sim[1];
+	mTestingExp = splited_exp[1];
 }
 
-
 void UnfoldingApp::Init()
 {
-	auto test_witnout_ui = false;
-	if( test_witnout_ui )
-	{
-		TestWithoutUI();
-		stop();
-	}
-	else
-	{ 
-		LoadData( "res/sim_p_6.txt" );
-		//LoadDataGaus( 5, 2.5 );
-		mMaxDims = (int)mInputData.mCols.size() / 2;
-		mUIData.mBinningType = BinningType::Static;
-		mUIData.mNeighborsMatType = NeighborsMatType::Binary;
-		mUIData.mBinsNum = BIN_SIZE;
-		mUIData.mDims = 1;
-		mUIData.mDimShift = 0;
-	}
+	LoadData( "res/sim_p_6.txt" );
+	//LoadDataGaus( 5, 2.5 );
+	mMaxDims = (int)mInputData.mSim.Dims();
+	mUIData.mBinningType = BinningType::Static;
+	mUIData.mNeighborsMatType = NeighborsMatType::Binary;
+	mUIData.mBinsNum = BIN_SIZE;
+	mUIData.mDims = 1;
+	mUIData.mDimShift = 0;
 }
 
 void UnfoldingApp::Update()
@@ -142,7 +299,7 @@ void UnfoldingApp::Update()
 	{
 		try {
 			LoadData( mUIData.mFilePath );
-			mUIData.mRebinning = true;
+			mUIData.mRecompute = true;
 		}
 		catch( const std::exception& e ) {
 			std::cerr << e.what() << std::endl;
@@ -150,25 +307,31 @@ void UnfoldingApp::Update()
 		mUIData.mFilePath.clear();
 	}
 
-	// Binning
-	if( mUIData.mRebinning )
+	// Binning and solving on the worker, a newer request supersedes the running one
+	if( mUIData.mRecompute && !mInputData.mCols.empty() )
 	{
-		// free space
-		mBins = Bins();
-		mMigrationMat = dfMat();
+		PostCompute();
+		mUIData.mRecompute = false;
+	}
 
-		// calculate
-		mBins = CalculateBins( mTrainingSim,
-							   mTrainingExp,
-							   mUIData.mDims,
-							   mUIData.mDimShift,
-							   mUIData.mBinningType,
-							   mUIData.mBinsNum );
-		mUIData.mRebinning = false;
+	std::unique_ptr<ComputeResult> completed;
+	std::unique_ptr<dfVec> completed_errors;
+	{
+		std::lock_guard lock( mCompletedMutex );
+		completed = std::move( mCompleted );
+		completed_errors = std::move( mCompletedErrors );
+	}
+	if( completed )
+	{
+		mResult = std::move( *completed );
 		mUIData.mUpdateBinningAxises = true;
 		mUIData.mUpdateErrorAxises = true;
-		mMigrationMat = CalculateMigrationMat( mBins );
-		UpdateUIData();
+	}
+	// Errors of the shown result, its job publishes nothing after them
+	if( completed_errors )
+	{
+		mResult.mSolutionErrors = std::move( *completed_errors );
+		mUIData.mUpdateErrorAxises = true;
 	}
 }
 
@@ -181,7 +344,7 @@ void UnfoldingApp::DrawTopBar()
 			if( ImGui::MenuItem( "Open" ) )
 			{
 				ImGuiFileDialog::Instance()->OpenDialog( "ChooseFileDlgKey", "Choose File", ".txt", "." );
-				mUIData.mRebinning = true;
+				mUIData.mRecompute = true;
 			}
 			if( ImGui::MenuItem( "Exit" ) )
 				stop();
@@ -192,7 +355,7 @@ void UnfoldingApp::DrawTopBar()
 			if( ImGui::MenuItem( "Gaus" ) )
 			{
 				LoadDataGaus( 5, 2 );
-				mUIData.mRebinning = true;
+				mUIData.mRecompute = true;
 			}
 			ImGui::EndMenu();
 		}
@@ -221,30 +384,50 @@ void UnfoldingApp::Draw()
 	ImGui::Begin( "Controll panel" );
 	{
 		if( ImGui::SliderInt( "Dims", &mUIData.mDims, 1, mMaxDims ) )
-			mUIData.mRebinning = true;
+			mUIData.mRecompute = true;
 
 		if( ImGui::SliderInt( "DimShift", &mUIData.mDimShift, 0, mMaxDims - 1 ) )
-			mUIData.mRebinning = true;
+			mUIData.mRecompute = true;
 
 		if( ImGui::SliderInt( "Bins", &mUIData.mBinsNum, MIN_BIN_SIZE, MAX_BIN_SIZE ) )
-			mUIData.mRebinning = true;
+			mUIData.mRecompute = true;
 
 		if( ImGui::Combo( "Binning type", (int*)&mUIData.mBinningType, "static\0dynamic\0dynamic median\0hybrid\0maxi", 5 ) )
-			mUIData.mRebinning = true;
+			mUIData.mRecompute = true;
+
+		if( ImGui::Combo( "Unfolding method", (int*)&mUIData.mUnfoldingMethod, "tikhonov\0iterative", 2 ) )
+			mUIData.mRecompute = true;
+
+		if( mUIData.mUnfoldingMethod == UnfoldingMethod::Iterative )
+		{
+			if( ImGui::SliderInt( "Iterations", &mUIData.mIterations, 1, 100 ) )
+				mUIData.mRecompute = true;
+
+			if( ImGui::Checkbox( "Early stopping", &mUIData.mEarlyStopping ) )
+				mUIData.mRecompute = true;
+		}
 
 		if( ImGui::Combo( "Neighbors mat type", (int*)&mUIData.mNeighborsMatType, "binary\0nonbinary stat\0mass center", 3 ) )
-			mUIData.mRebinning = true;
+			mUIData.mRecompute = true;
 		
 		if( ImGui::SliderFloat( "Alpha", &mUIData.mAlpha, 0.0f, 0.05f ) )
-			mUIData.mRebinning = true;
+			mUIData.mRecompute = true;
 
 		if( ImGui::SliderFloat( "AlphaLow", &mUIData.mAlphaLow, 0, 1000 ) )
-			mUIData.mRebinning = true;
+			mUIData.mRecompute = true;
+
+		if( ImGui::Combo( "Alpha selection", (int*)&mUIData.mAlphaSelection, "manual\0l-curve\0gcv", 3 ) )
+			mUIData.mRecompute = true;
 
 		if( ImGui::Checkbox( "Debug output", &mUIData.mDebugOuput ) )
-			mUIData.mRebinning = true;
+			mUIData.mRecompute = true;
 
 		ImGui::Checkbox( "Migration mat values", &mUIData.mMibrationMatValues );
+
+		if( mWorker.Busy() )
+			ImGui::ProgressBar( mWorker.Progress(), ImVec2( -1, 0 ), "Calculating" );
+		else
+			ImGui::ProgressBar( 1.0f, ImVec2( -1, 0 ), "Done" );
 	}
 	ImGui::End();
 
@@ -259,28 +442,20 @@ void UnfoldingApp::Draw()
 		else
 		{
 			ImGui::Text( "Data distribution projection" );
-			
-			auto shift = mUIData.mDimShift * 2;
-			const auto& cols = mInputData.mCols;
-			for( size_t i = shift; i < mUIData.mDims * 2 + shift; i+=2 )
-			{
-				auto dim = i / 2;
-				auto exp_id = i % cols.size();
-				auto sim_id =  ( i + 1 ) % cols.size();
 
+			const auto& histograms = mResult.mDataHistograms;
+			for( size_t dim = 0; dim < histograms.size(); dim++ )
+			{
 				if( ImPlot::BeginPlot( std::format( "##Histogram{}", dim ).c_str() ) )
 				{
-					auto size = cols[dim].mData.size();
+					const auto& [exp, sim] = histograms[dim];
 
 					ImPlot::SetupAxes( NULL, NULL, ImPlotAxisFlags_AutoFit, ImPlotAxisFlags_AutoFit );
-					ImPlot::SetNextFillStyle( IMPLOT_AUTO_COL, 0.5f );
 					ImPlot::SetNextFillStyle( ImVec4{ 0.7f, 0.4f, 0.1f, 0.9f }, 0.4f );
-					auto exp_name = std::format( "{} dim:{}", cols[exp_id].mName, dim);
-					ImPlot::PlotHistogram( exp_name.c_str(), cols[exp_id].mData.data(), (int)size, ImPlotBin_Scott );
+					ImPlot::PlotBars( exp.mName.c_str(), exp.mXs.data(), exp.mYs.data(), (int)exp.mXs.size(), exp.mWidth );
 
 					ImPlot::SetNextFillStyle( ImVec4{ 0.3f, 0.4f, 0.7f, 0.9f }, 0.4f );
-					auto sim_name = std::format( "{} dim:{}", cols[sim_id].mName, dim );
-					ImPlot::PlotHistogram( sim_name.c_str(), cols[sim_id].mData.data(), (int)size, ImPlotBin_Scott );
+					ImPlot::PlotBars( sim.mName.c_str(), sim.mXs.data(), sim.mYs.data(), (int)sim.mXs.size(), sim.mWidth );
 					ImPlot::EndPlot();
 				}
 			}
@@ -296,8 +471,8 @@ void UnfoldingApp::Draw()
 	{
 		ImGui::Begin( "Binning" );
 		// 1D projection
-		auto& projections1d = mUIData.mProjections1D;
-		for( size_t dim = 0; dim < mBins.Dims(); dim++ )
+		auto& projections1d = mResult.mProjections1D;
+		for( size_t dim = 0; dim < mResult.mDims; dim++ )
 		{
 			if( mUIData.mUpdateBinningAxises )
 				ImPlot::SetNextAxesToFit();
@@ -319,10 +494,10 @@ void UnfoldingApp::Draw()
 
 		// 2D projection
 		ImPlot::PushColormap( mUIData.mColorMap );
-		auto& projections2d = mUIData.mProjections2D;
-		if( mBins.Dims() > 1 )
+		auto& projections2d = mResult.mProjections2D;
+		if( mResult.mDims > 1 )
 		{
-			for( size_t dim = 0; dim < mBins.Dims(); dim++ )
+			for( size_t dim = 0; dim < mResult.mDims; dim++ )
 			{
 				if( ImPlot::BeginPlot( std::format( "##BinningHeat{}", dim ).c_str() ) )
 				{
@@ -354,12 +529,14 @@ void UnfoldingApp::Draw()
 		ImPlot::ColormapScale( "Color range", 0, 1, ImVec2( 0, -1 ) );
 		ImGui::SameLine();
 
-		if( ImPlot::BeginPlot( "##Heatmap", ImVec2( -1, -1 ), ImPlotFlags_NoLegend | ImPlotFlags_NoMouseText ) )
+		if( mResult.mMigrationSize == 0 )
+			ImGui::Text( "Migration mat isn't shown for more than %d bins", (int)SPARSE_SOLVER_MIN_BINS );
+		else if( ImPlot::BeginPlot( "##Heatmap", ImVec2( -1, -1 ), ImPlotFlags_NoLegend | ImPlotFlags_NoMouseText ) )
 		{
 			ImPlot::PlotHeatmap( "Migration mat",
-								 mUIData.mMigrationRaw.data(),
-								 (int)mMigrationMat.rows(),
-								 (int)mMigrationMat.cols(),
+								 mResult.mMigrationRaw.data(),
+								 mResult.mMigrationSize,
+								 mResult.mMigrationSize,
 								 0.0,
 								 1.0,
 								 mUIData.mMibrationMatValues ? "%.3f" : NULL,
@@ -380,8 +557,8 @@ void UnfoldingApp::Draw()
 
 		if( ImPlot::BeginPlot( "##OriginalError" ) )
 		{
-			auto& sim_hist = mUIData.mSimTestHist;
-			auto& exp_hist = mUIData.mExpTestHist;
+			auto& sim_hist = mResult.mSimTestHist;
+			auto& exp_hist = mResult.mExpTestHist;
 
 			std::vector<Float> xs;
 			for( int i = 0; i < sim_hist.length(); i++ )
@@ -415,9 +592,9 @@ void UnfoldingApp::Draw()
 
 		if( ImPlot::BeginPlot( "##SolutionError" ) )
 		{
-			auto& sim_hist = mUIData.mSimTestHist;
-			auto& exp_hist = mUIData.mExpTestHist;
-			auto& solution = mUIData.mSolution;
+			auto& sim_hist = mResult.mSimTestHist;
+			auto& exp_hist = mResult.mExpTestHist;
+			auto& solution = mResult.mSolution;
 			
 			std::vector<Float> xs;
 			for( int i = 0; i < solution.length(); i++ )
@@ -443,9 +620,57 @@ void UnfoldingApp::Draw()
 				total_error += e;
 			}
 			total_error /= (Float)xs.size();
-			ImPlot::PlotErrorBars( "Sqr error", xs.data(), ys.data(), errors.data(), (int)xs.size() );
+
+			// Propagated statistical errors when the method gives them
+			const auto& solution_errors = mResult.mSolutionErrors;
+			if( solution_errors.length() == solution.length() )
+				ImPlot::PlotErrorBars( "Stat error", xs.data(), solution.getcontent(), solution_errors.getcontent(), (int)xs.size() );
+			else
+				ImPlot::PlotErrorBars( "Sqr error", xs.data(), ys.data(), errors.data(), (int)xs.size() );
 			ImPlot::EndPlot();
-			ImGui::Text( "MSE %0.3f", total_error );
+			ImGui::Text( "MSE %0.3f alpha %g", total_error, mResult.mAlpha );
+		}
+
+		// Alpha scan, log10 of values so the plots don't depend on log axes support
+		const auto& scan = mResult.mAlphaScan;
+		auto log10 = []( const std::vector<Float>& values )
+		{
+			std::vector<Float> res;
+			for( auto value : values )
+				res.push_back( std::log10( value ) );
+			return res;
+		};
+		if( !scan.mAlphas.empty() )
+		{
+			auto alphas = log10( scan.mAlphas );
+			auto residuals = log10( scan.mResidualNorms );
+			auto solutions = log10( scan.mSolutionNorms );
+			auto gcv = log10( scan.mGcv );
+			auto corner = scan.mLCurveCorner;
+			auto gcv_min = scan.mGcvMin;
+
+			if( mUIData.mUpdateErrorAxises )
+				ImPlot::SetNextAxesToFit();
+			if( ImPlot::BeginPlot( "##LCurve" ) )
+			{
+				ImPlot::SetupAxes( "log |A tau - m|", "log penalty norm" );
+				ImPlot::PlotLine( "L-curve", residuals.data(), solutions.data(), (int)residuals.size() );
+				ImPlot::SetNextMarkerStyle( ImPlotMarker_Circle );
+				ImPlot::PlotScatter( "corner", &residuals[corner], &solutions[corner], 1 );
+				ImPlot::EndPlot();
+			}
+
+			if( mUIData.mUpdateErrorAxises )
+				ImPlot::SetNextAxesToFit();
+			if( ImPlot::BeginPlot( "##Gcv" ) )
+			{
+				ImPlot::SetupAxes( "log alpha", "log GCV" );
+				ImPlot::PlotLine( "GCV", alphas.data(), gcv.data(), (int)alphas.size() );
+				ImPlot::SetNextMarkerStyle( ImPlotMarker_Circle );
+				ImPlot::PlotScatter( "min", &alphas[gcv_min], &gcv[gcv_min], 1 );
+				ImPlot::EndPlot();
+			}
+			ImGui::Text( "L-curve alpha %g, GCV alpha %g", scan.mAlphas[corner], scan.mAlphas[gcv_min] );
 		}
 		mUIData.mUpdateErrorAxises = false;
 	}
@@ -455,7 +680,7 @@ void UnfoldingApp::Draw()
 	// Singular values
 	ImGui::Begin( "Singular valus" );
 	{
-		auto [U, s, Vt] = SVD( mMigrationMat );
+		const auto& s = mResult.mSingularValues;
 		dfVec log;
 		log.setlength( s.length() );
 		std::vector<Float> xs;
@@ -3,25 +3,100 @@
 #include "core/Application.hpp"
 #include "load_data.hpp"
 #include "system_solver.hpp"
+#include "iterative_solver.hpp"
+#include "linalg_cache.hpp"
+#include "binning_pipeline.hpp"
+#include "compute_worker.hpp"
 #include "bin.hpp"
 
 #include <imgui.h>
 #include <implot.h>
 
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <tuple>
+
 using App::Application;
 
 class UnfoldingApp : public Application
 {
+	// Parameters of one computation, copied from the UI when it's posted
+	struct ComputeRequest
+	{
+		int mBinsNum;
+		int mDims;
+		int mDimShift;
+		BinningType mBinningType;
+		NeighborsMatType mNeighborsMatType;
+		UnfoldingMethod mUnfoldingMethod;
+		size_t mIterations;
+		Float mTolerance;
+		double mAlpha;
+		AlphaSelection mAlphaSelection;
+		bool mDebugOuput;
+
+		auto BinningKey() const
+		{
+			return std::tie( mBinsNum, mDims, mDimShift, mBinningType );
+		}
+	};
+
+	struct DataHistogram
+	{
+		std::string mName;
+		std::vector<Float> mXs;
+		std::vector<Float> mYs;
+		Float mWidth = 1;
+	};
+
+	// Everything Draw() shows, replaced at once when a job completes
+	struct ComputeResult
+	{
+		size_t mDims = 0;
+		std::vector<std::pair<DataHistogram, DataHistogram>> mDataHistograms;
+		BinningProjections1D mProjections1D;
+		BinningProjections2D mProjections2D;
+		int mMigrationSize = 0;
+		std::vector<Float> mMigrationRaw;
+		dfVec mSimTestHist;
+		dfVec mExpTestHist;
+		dfVec mSolution;
+		// Statistical errors of the solution, empty if the method doesn't propagate them
+		dfVec mSolutionErrors;
+		dfVec mSingularValues;
+		AlphaScan mAlphaScan;
+		Float mAlpha = 0;
+	};
+
+	// Touched only by the worker thread, or after ComputeWorker::Cancel()
+	struct ComputeState
+	{
+		std::optional<ComputeRequest> mBinningRequest;
+		Bins mBins;
+		BinningStats mBinningStats;
+		LinAlgCache mLinAlgCache;
+		std::vector<std::pair<DataHistogram, DataHistogram>> mDataHistograms;
+		dfVec mSimTestHist;
+		dfVec mExpTestHist;
+		// Solution errors of the last ( binning version, neighbors type, alpha ) they were finished for
+		dfVec mSolutionErrors;
+		std::optional<std::tuple<size_t, NeighborsMatType, Float>> mSolutionErrorsKey;
+	};
+
 	InputData mInputData;
-	Bins mBins;
-	Bins mBinsProjection;
-	dfMat mMigrationMat;
+	ComputeState mComputeState;
+	ComputeResult mResult;
+	// Errors come after their result, both are taken under one lock so they are never mixed up
+	std::mutex mCompletedMutex;
+	std::unique_ptr<ComputeResult> mCompleted;
+	std::unique_ptr<dfVec> mCompletedErrors;
 
 	int mMaxDims;
-	std::span<sfVec> mTrainingSim;
-	std::span<sfVec> mTrainingExp;
-	std::span<sfVec> mTestingSim;
-	std::span<sfVec> mTestingExp;
+	EventsView mTrainingSim;
+	EventsView mTrainingExp;
+	EventsView mTestingSim;
+	EventsView mTestingExp;
 
 	struct UIData
 	{
@@ -30,28 +105,28 @@ class UnfoldingApp : public Application
 		int mDimShift;
 		BinningType mBinningType;
 		NeighborsMatType mNeighborsMatType;
+		UnfoldingMethod mUnfoldingMethod = UnfoldingMethod::Tikhonov;
+		int mIterations = (int)ITERATIVE_DEFAULT_ITERATIONS;
+		bool mEarlyStopping = true;
 		bool mDebugOuput = false;
 		float mAlpha = 0.000f;
 		float mAlphaLow = 0.0001f;
+		AlphaSelection mAlphaSelection = AlphaSelection::Manual;
 
 		std::string mFilePath;
 		bool mMibrationMatValues = false;
 		ImPlotColormap mColorMap = ImPlotColormap_Greys;
 
 
-		bool mRebinning = true;
+		bool mRecompute = true;
 		bool mUpdateBinningAxises = false;
 		bool mUpdateErrorAxises = false;
-
-		BinningProjections1D mProjections1D;
-		BinningProjections2D mProjections2D;
-		std::vector<Float> mMigrationRaw;
-		dfVec mSimTestHist;
-		dfVec mExpTestHist;
-		dfVec mSolution;
 	};
 	UIData mUIData;
 
+	// Declared last, so it's stopped before the data its jobs use is destroyed
+	ComputeWorker mWorker;
+
 public:
 	using Application::Application;
 
@@ -63,6 +138,10 @@ public:
 private:
 	void LoadData( const std::string& filename );
 	void LoadDataGaus( Float M, Float D );
-	void UpdateUIData();
-	void TestWithoutUI();
+	void ResetData();
+	void SplitInputData();
+	void PostCompute();
+	void Compute( const ComputeRequest& request, const JobContext& context );
+	void ComputeSolutionErrors( const ComputeRequest& request, Float alpha, const JobContext& context );
+	std::pair<DataHistogram, DataHistogram> CalculateDataHistograms( size_t dim ) const;
 };
\ No newline at end of file